@@ -0,0 +1,104 @@
+/*
+
+environment.cpp
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Implementation of Environment as
+a persistent treap.
+
+*/
+
+#include "environment.h"
+
+using namespace std;
+
+// ******************** //
+// * Public Functions * //
+// ******************** //
+
+// Constructor for an empty environment
+Environment::Environment() : count(0) {}
+
+// Look up a variable; returns false if it is not set
+bool Environment::find(const string &name, Value &val) const {
+	const EnvNode *node = root.get();
+	while(node != NULL) {
+		int cmp = name.compare(node->name);
+		if(cmp == 0) {
+			val = node->value;
+			return true;
+		}
+		node = cmp < 0 ? node->left.get() : node->right.get();
+	}
+	return false;
+}
+
+// Set or replace a variable
+void Environment::set(const string &name, const Value &val) {
+	bool added = false;
+	root = insert(root, name, val, hash<string>()(name), added);
+	if(added) count++;
+}
+
+int Environment::size() const {
+	return count;
+}
+
+// Call visit for every variable, in order of name
+void Environment::forEach(function<void(const string &, const Value &)> visit) const {
+	visitTree(root, visit);
+}
+
+// ********************* //
+// * Private Functions * //
+// ********************* //
+
+EnvNodePtr Environment::insert(const EnvNodePtr &node, const string &name,
+	const Value &val, size_t priority, bool &added) {
+	if(!node) {
+		added = true;
+		return make_shared<const EnvNode>(name, val, priority, EnvNodePtr(), EnvNodePtr());
+	}
+	
+	int cmp = name.compare(node->name);
+	if(cmp == 0) {
+		return make_shared<const EnvNode>(name, val, node->priority, node->left, node->right);
+	}
+	
+	if(cmp < 0) {
+		EnvNodePtr left = insert(node->left, name, val, priority, added);
+		
+		// Rotate right if the new child has the higher priority
+		if(left->priority > node->priority) {
+			EnvNodePtr lowered = make_shared<const EnvNode>(node->name, node->value,
+				node->priority, left->right, node->right);
+			return make_shared<const EnvNode>(left->name, left->value,
+				left->priority, left->left, lowered);
+		}
+		return make_shared<const EnvNode>(node->name, node->value,
+			node->priority, left, node->right);
+	}
+	else {
+		EnvNodePtr right = insert(node->right, name, val, priority, added);
+		
+		// Rotate left if the new child has the higher priority
+		if(right->priority > node->priority) {
+			EnvNodePtr lowered = make_shared<const EnvNode>(node->name, node->value,
+				node->priority, node->left, right->left);
+			return make_shared<const EnvNode>(right->name, right->value,
+				right->priority, lowered, right->right);
+		}
+		return make_shared<const EnvNode>(node->name, node->value,
+			node->priority, node->left, right);
+	}
+}
+
+void Environment::visitTree(const EnvNodePtr &node,
+	function<void(const string &, const Value &)> &visit) {
+	if(!node) return;
+	visitTree(node->left, visit);
+	visit(node->name, node->value);
+	visitTree(node->right, visit);
+}
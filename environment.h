@@ -0,0 +1,78 @@
+/*
+
+environment.h
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Header file for Environment, the
+persistent map of variables of an ExpSolver
+session. Nodes are immutable and shared between
+environments: copying an environment is O(1), and
+setting a variable copies only the O(log n) nodes
+on the path to it. An environment that is no
+longer modified can be read from many threads.
+
+*/
+
+#include <string>
+#include <memory>
+#include <functional>
+#include "value.h"
+
+using namespace std;
+
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+// Node of the tree; never modified once created
+struct EnvNode;
+typedef shared_ptr<const EnvNode> EnvNodePtr;
+
+struct EnvNode {
+	string name;
+	Value value;
+	
+	// Heap priority of the treap, a hash of the name, so
+	// the shape of the tree doesn't depend on insertion order
+	size_t priority;
+	
+	EnvNodePtr left, right;
+	EnvNode(const string &nm, const Value &val, size_t pr,
+		const EnvNodePtr &l, const EnvNodePtr &r)
+		: name(nm), value(val), priority(pr), left(l), right(r) {}
+};
+
+class Environment {
+public:
+	
+	// Constructor for an empty environment
+	Environment(void);
+	
+	// Look up a variable; returns false if it is not set
+	bool find(const string &name, Value &val) const;
+	
+	// Set or replace a variable
+	void set(const string &name, const Value &val);
+	
+	// Number of variables
+	int size(void) const;
+	
+	// Call visit for every variable, in order of name
+	void forEach(function<void(const string &, const Value &)> visit) const;
+
+private:
+	
+	EnvNodePtr root;
+	int count;
+	
+	// Return the tree of node with name set to val; only nodes
+	// on the path to name are copied
+	static EnvNodePtr insert(const EnvNodePtr &node, const string &name,
+		const Value &val, size_t priority, bool &added);
+	
+	static void visitTree(const EnvNodePtr &node,
+		function<void(const string &, const Value &)> &visit);
+};
+
+#endif
@@ -0,0 +1,396 @@
+/*
+
+exp_literal.h
+
+Author: Jingyun Yang
+Date Created: 10/18/26
+
+Description: Compile-time front end for formulas
+written as string literals (requires C++20).
+	
+	auto f = "x^2+3*x"_expr;
+	Value y = f(2);        // Ans = 10
+
+The literal is lexed, validated and compiled into
+a postfix program while compiling, with the grammar
+of ExpSolver: numbers, '+' '-' '*' '/' '^', brackets,
+"-" after '(' or at the start, constants "pi" "e" and
+the predefined functions. Syntax errors are compile
+errors. Number constants are precomputed (exact
+fractions where ExpSolver keeps them exact).
+
+Any other name is a variable. Variables are bound
+by position, in order of first appearance.
+
+*/
+
+#ifndef EXP_LITERAL_H
+#define EXP_LITERAL_H
+
+#if __cplusplus >= 202002L
+
+#include <stddef.h>
+#include <limits.h>
+#include <math.h>
+#include "value.h"
+
+template<size_t N>
+struct ExpText {
+	char text[N];
+	constexpr ExpText(const char (&str)[N]) {
+		for(size_t i = 0; i < N; i++) text[i] = str[i];
+	}
+};
+
+enum LiteralOpType {
+	LitFraction, LitDecimal, LitVariable, LitFunction,
+	LitAdd, LitSub, LitMul, LitDiv, LitPow
+};
+
+enum LiteralFunction {
+	LitSin, LitCos, LitTan, LitExp, LitSqrt, LitFloor, LitLn, LitLog
+};
+
+struct LiteralOp {
+	LiteralOpType type;
+	int up, down;
+	double dec;
+	int index;
+};
+
+// Postfix program compiled from a literal of N characters
+// An expression of N characters never needs more than 2*N ops
+template<size_t N>
+struct LiteralProgram {
+	LiteralOp ops[2*N];
+	int opCount;
+	int stackDepth;
+	
+	// Cleaned text (spaces removed) and variable names in it
+	char text[N];
+	int nameStart[N], nameLength[N];
+	int variableCount;
+};
+
+// Recursive descent parser; runs only during constant evaluation
+template<size_t N>
+class LiteralParser {
+public:
+	constexpr LiteralParser(const char (&str)[N]) : prog(), pos(0), len(0), depth(0) {
+		// Discard spaces, as ExpSolver does
+		for(size_t i = 0; i + 1 < N; i++) {
+			char c = str[i];
+			if(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') continue;
+			prog.text[len++] = c;
+		}
+		prog.text[len] = '\0';
+		prog.opCount = 0;
+		prog.stackDepth = 0;
+		prog.variableCount = 0;
+	}
+	
+	constexpr LiteralProgram<N> compile() {
+		if(len == 0) fail("Invalid expression!");
+		for(int i = 0; i < len; i++) {
+			if(prog.text[i] == '=') fail("Declarations can't be compiled!");
+		}
+		parseExp();
+		if(pos != len) {
+			if(prog.text[pos] == ')') fail("Syntax error: Brackets not paired!");
+			fail("Invalid expression!");
+		}
+		return prog;
+	}
+
+private:
+	LiteralProgram<N> prog;
+	int pos, len, depth;
+	
+	// A throw can't be constant evaluated, so this
+	// turns every syntax error into a compile error
+	constexpr void fail(const char *message) {
+		throw message;
+	}
+	
+	static constexpr bool isAlpha(char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+	}
+	
+	static constexpr bool isDigit(char c) {
+		return (c >= '0' && c <= '9') || c == '.';
+	}
+	
+	constexpr void emit(LiteralOp op) {
+		// Track the evaluation stack to size it at compile time
+		if(op.type == LitFraction || op.type == LitDecimal || op.type == LitVariable) depth++;
+		else if(op.type != LitFunction) depth--;
+		if(depth > prog.stackDepth) prog.stackDepth = depth;
+		prog.ops[prog.opCount++] = op;
+	}
+	
+	constexpr void emitOp(LiteralOpType type) {
+		emit(LiteralOp{type, 0, 1, 0.0, 0});
+	}
+	
+	// exp := ['-'] term (('+'|'-') term)*
+	// A leading '-' reads as "0-", like dealWithNegativeSign
+	constexpr void parseExp() {
+		if(pos < len && prog.text[pos] == '-') {
+			emit(LiteralOp{LitFraction, 0, 1, 0.0, 0});
+		}
+		else {
+			parseTerm();
+		}
+		while(pos < len && (prog.text[pos] == '+' || prog.text[pos] == '-')) {
+			char op = prog.text[pos++];
+			parseTerm();
+			emitOp(op == '+' ? LitAdd : LitSub);
+		}
+	}
+	
+	// term := power (('*'|'/') power)*
+	constexpr void parseTerm() {
+		parsePower();
+		while(pos < len && (prog.text[pos] == '*' || prog.text[pos] == '/')) {
+			char op = prog.text[pos++];
+			parsePower();
+			emitOp(op == '*' ? LitMul : LitDiv);
+		}
+	}
+	
+	// power := operand ('^' operand)*, left associative as in ExpSolver
+	constexpr void parsePower() {
+		parseOperand();
+		while(pos < len && prog.text[pos] == '^') {
+			pos++;
+			parseOperand();
+			emitOp(LitPow);
+		}
+	}
+	
+	// operand := number | constant | variable | function '(' exp ')' | '(' exp ')'
+	constexpr void parseOperand() {
+		if(pos >= len) fail("Invalid expression!");
+		char c = prog.text[pos];
+		if(c == '(') {
+			pos++;
+			parseBracket();
+		}
+		else if(isDigit(c)) {
+			parseNumber();
+		}
+		else if(isAlpha(c)) {
+			parseName();
+		}
+		else if(c == ')') {
+			fail("Invalid expression!");
+		}
+		else if(c == '+' || c == '-' || c == '*' || c == '/' || c == '^') {
+			fail("Invalid expression!");
+		}
+		else {
+			fail("Encountered unknown character!");
+		}
+	}
+	
+	// Contents of a bracket whose '(' was just read
+	constexpr void parseBracket() {
+		if(pos < len && prog.text[pos] == ')') fail("Invalid expression!");
+		parseExp();
+		if(pos >= len) fail("Syntax error: Brackets not paired!");
+		if(prog.text[pos] != ')') fail("Invalid expression!");
+		pos++;
+	}
+	
+	// Numbers follow Value(string): up to 5 decimal places stay exact
+	constexpr void parseNumber() {
+		int start = pos;
+		int dot = -1;
+		while(pos < len && isDigit(prog.text[pos])) {
+			if(prog.text[pos] == '.') {
+				if(dot >= 0) fail("Arithmatic Error: More than one '.' in a number!");
+				dot = pos;
+			}
+			pos++;
+		}
+		int leftEnd = dot >= 0 ? dot : pos;
+		
+		// Like Value(string): a decimal has at most 9 digits before the
+		// point, and a whole number (at most 11 digits) must fit in an int
+		if(dot >= 0 && leftEnd - start >= 10) fail("Arithmatic error: Number too large!");
+		if(dot < 0 && pos - start > 11) fail("Arithmatic error: Number too large!");
+		
+		long long left = 0;
+		for(int i = start; i < leftEnd; i++) left = left*10 + (prog.text[i] - '0');
+		
+		// Trailing zeros of the decimal part don't count
+		int rightEnd = pos;
+		if(dot >= 0) {
+			while(rightEnd > dot + 1 && prog.text[rightEnd-1] == '0') rightEnd--;
+		}
+		int places = dot >= 0 ? rightEnd - dot - 1 : 0;
+		
+		if(places <= 5) {
+			long long up = left, down = 1;
+			for(int i = dot + 1; dot >= 0 && i < rightEnd; i++) {
+				up = up*10 + (prog.text[i] - '0');
+				down *= 10;
+			}
+			if(up > INT_MAX) fail("Arithmatic error: Number too large!");
+			long long a = up, b = down;
+			while(b != 0) { long long t = a % b; a = b; b = t; }
+			if(a > 1) { up /= a; down /= a; }
+			emit(LiteralOp{LitFraction, (int)up, (int)down, 0.0, 0});
+		}
+		else {
+			// mantissa / 10^places is correctly rounded while
+			// both sides are exact doubles
+			double mantissa = 0, scale = 1;
+			for(int i = start; i < rightEnd; i++) {
+				if(i == dot) continue;
+				mantissa = mantissa*10 + (prog.text[i] - '0');
+			}
+			for(int i = 0; i < places; i++) scale *= 10;
+			emit(LiteralOp{LitDecimal, 0, 1, mantissa / scale, 0});
+		}
+	}
+	
+	constexpr bool nameIs(int start, int length, const char *name) {
+		int i = 0;
+		for(; name[i] != '\0'; i++) {
+			if(i >= length || prog.text[start+i] != name[i]) return false;
+		}
+		return i == length;
+	}
+	
+	constexpr void parseName() {
+		int start = pos;
+		while(pos < len && (isAlpha(prog.text[pos]) || isDigit(prog.text[pos]))) pos++;
+		int length = pos - start;
+		
+		// Predefined functions, in the order of ExpSolver::addPredefined
+		const char *functionNames[] = {"sin", "cos", "tan", "exp", "sqrt", "floor", "ln", "log"};
+		for(int f = 0; f < 8; f++) {
+			if(nameIs(start, length, functionNames[f])) {
+				if(pos >= len || prog.text[pos] != '(') {
+					fail("Syntax Error: Need brackets after function name!");
+				}
+				pos++;
+				parseBracket();
+				emit(LiteralOp{LitFunction, 0, 1, 0.0, f});
+				return;
+			}
+		}
+		
+		// Value(M_E) and Value(M_PI) keep 6 decimal places
+		if(nameIs(start, length, "e")) {
+			emit(LiteralOp{LitDecimal, 0, 1, 2.718282, 0});
+			return;
+		}
+		if(nameIs(start, length, "pi")) {
+			emit(LiteralOp{LitDecimal, 0, 1, 3.141593, 0});
+			return;
+		}
+		if(nameIs(start, length, "ans")) fail("Bad access: \"ans\" can't be compiled!");
+		
+		// Variable: reuse the slot of an earlier appearance
+		int slot = 0;
+		for(; slot < prog.variableCount; slot++) {
+			if(prog.nameLength[slot] != length) continue;
+			bool same = true;
+			for(int i = 0; i < length; i++) {
+				if(prog.text[prog.nameStart[slot]+i] != prog.text[start+i]) same = false;
+			}
+			if(same) break;
+		}
+		if(slot == prog.variableCount) {
+			prog.nameStart[slot] = start;
+			prog.nameLength[slot] = length;
+			prog.variableCount++;
+		}
+		emit(LiteralOp{LitVariable, 0, 1, 0.0, slot});
+	}
+};
+
+// Callable produced by the _expr literal
+template<ExpText S>
+struct ExpLiteral {
+	static constexpr LiteralProgram<sizeof(S.text)> program =
+		LiteralParser<sizeof(S.text)>(S.text).compile();
+	
+	// Number of variables the formula has to be given
+	static constexpr int variableCount() {
+		return program.variableCount;
+	}
+	
+	// Name of the variable bound at position slot
+	static string variableName(int slot) {
+		return string(program.text + program.nameStart[slot], program.nameLength[slot]);
+	}
+	
+	// Evaluate with variables bound in order of first appearance
+	template<class... Args>
+	Value operator()(const Args &... args) const {
+		static_assert(sizeof...(Args) == program.variableCount,
+			"Wrong number of variables for this formula");
+		Value slots[sizeof...(Args) + 1] = {Value(args)...};
+		
+		Value stack[program.stackDepth];
+		int top = 0;
+		for(int i = 0; i < program.opCount; i++) {
+			const LiteralOp &op = program.ops[i];
+			switch(op.type) {
+			case LitFraction: {
+				// Already reduced, so skip the Fraction constructor
+				Fraction fv;
+				fv.up = op.up;
+				fv.down = op.down;
+				stack[top++] = Value(fv, (double)op.up / op.down, false, true);
+				break;
+			}
+			case LitDecimal:
+				stack[top++] = Value(Fraction(), op.dec, true, true);
+				break;
+			case LitVariable:
+				stack[top++] = slots[op.index];
+				break;
+			case LitFunction:
+				stack[top-1] = callFunction(op.index, stack[top-1]);
+				break;
+			case LitAdd: top--; stack[top-1] += stack[top]; break;
+			case LitSub: top--; stack[top-1] -= stack[top]; break;
+			case LitMul: top--; stack[top-1] *= stack[top]; break;
+			case LitDiv: top--; stack[top-1] /= stack[top]; break;
+			case LitPow: top--; stack[top-1].powv(stack[top]); break;
+			}
+		}
+		return stack[0];
+	}
+
+private:
+	// Functions apply to every element of an array argument
+	static Value callFunction(int index, Value arg) {
+		if(!arg.getCalculability()) return Value();
+		switch(index) {
+		case LitSin: return arg.applyFunction(sin);
+		case LitCos: return arg.applyFunction(cos);
+		case LitTan: return arg.applyFunction(tan);
+		case LitExp: return arg.applyFunction(exp);
+		case LitSqrt: return arg.applyFunction(sqrt);
+		case LitFloor: return arg.applyFunction(floor);
+		case LitLn: return arg.applyFunction(log);
+		default: return arg.applyFunction(log10);
+		}
+	}
+};
+
+template<ExpText S>
+consteval ExpLiteral<S> operator""_expr() {
+	// Compile the formula here so that syntax errors point at the literal
+	static_assert(ExpLiteral<S>::program.opCount > 0, "Invalid expression!");
+	return ExpLiteral<S>();
+}
+
+#endif
+
+#endif
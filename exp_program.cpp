@@ -0,0 +1,611 @@
+/*
+
+exp_program.cpp
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Implementation of ExpProgram.
+Operators follow ExpSolver::calculateExp, so a
+program gives the same results as solving the
+expression with the variable replaced by a number
+(up to the rounding of Value).
+
+Sums and products split the range of the variable
+into blocks of fixed size. Each block is added up
+(with Kahan's compensated summation) in batches
+evaluated together, and the blocks are combined
+pairwise, so the result is the same however many
+threads share the blocks.
+
+*/
+
+#include <math.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include "exp_program.h"
+#include "task_pool.h"
+
+using namespace std;
+
+// Root finding stops once the root is known to this precision
+static const double ROOT_TOLERANCE = 1e-12;
+static const int ROOT_MAX_ITERATIONS = 200;
+
+// A root must be small next to the program at the bounds, or next to
+// the program this far (relative to the root) on either side of it
+static const double ROOT_RESIDUAL = 1e-9;
+static const double ROOT_CHECK_WIDTH = 1e-8;
+
+// Points between the bounds where sign changes are looked for
+// when the first one found isn't a root
+static const int ROOT_SCAN_POINTS = 1024;
+
+// Iterations of a sum or product in one partial result, and
+// values of the variable evaluated together
+static const long long REDUCE_BLOCK = 4096;
+static const int REDUCE_BATCH = 256;
+
+// Largest sum or product that is rounded through Value(double)
+static const double REDUCE_ROUNDED_MAX = 1e8;
+
+// Multiply, checking for overflow
+static bool checkedMultiply(long long a, long long b, long long &result) {
+	if(a != 0 && llabs(b) > LLONG_MAX / llabs(a)) return false;
+	result = a * b;
+	return true;
+}
+
+static long long gcdOf(long long a, long long b) {
+	a = llabs(a);
+	b = llabs(b);
+	while(b != 0) { long long t = a % b; a = b; b = t; }
+	return a;
+}
+
+// Add ('+') or multiply ('*') term into the fraction up/down,
+// keeping it reduced; returns false on overflow
+static bool combineFraction(char op, long long &up, long long &down, const Fraction &term) {
+	long long termUp = term.up, termDown = term.down;
+	if(termDown < 0) {
+		termUp = -termUp;
+		termDown = -termDown;
+	}
+	if(op == '+') {
+		long long g = gcdOf(down, termDown), left, right;
+		if(!checkedMultiply(up, termDown / g, left)
+			|| !checkedMultiply(termUp, down / g, right)
+			|| !checkedMultiply(down / g, termDown, down)) return false;
+		if((right > 0 && left > LLONG_MAX - right)
+			|| (right < 0 && left < -LLONG_MAX - right)) return false;
+		up = left + right;
+	}
+	else {
+		// Cancel across first so that the products stay small
+		long long g1 = gcdOf(up, termDown), g2 = gcdOf(termUp, down);
+		if(!checkedMultiply(up / g1, termUp / g2, up)
+			|| !checkedMultiply(down / g2, termDown / g1, down)) return false;
+	}
+	long long g = gcdOf(up, down);
+	if(g > 1) {
+		up /= g;
+		down /= g;
+	}
+	return true;
+}
+
+// ******************** //
+// * Public Functions * //
+// ******************** //
+
+// Constructor for an empty program
+ExpProgram::ExpProgram() : depth(0), stackSize(0), differentiable(true) {}
+
+void ExpProgram::pushConstant(const Value &value) {
+	ProgramOp instruction(PushConstant);
+	instruction.constant = value.getDecValue();
+	instruction.exact = value;
+	code.push_back(instruction);
+	stackSize = max(stackSize, ++depth);
+}
+
+void ExpProgram::pushVariable() {
+	code.push_back(ProgramOp(PushVariable));
+	stackSize = max(stackSize, ++depth);
+}
+
+void ExpProgram::pushOperator(char op) {
+	ProgramOp instruction(ApplyOperator);
+	instruction.op = op;
+	code.push_back(instruction);
+	depth--;
+}
+
+void ExpProgram::pushFunction(double (*func)(double), double (*deriv)(double)) {
+	ProgramOp instruction(ApplyFunction);
+	instruction.func = func;
+	instruction.deriv = deriv;
+	code.push_back(instruction);
+	if(deriv == NULL) differentiable = false;
+}
+
+// Evaluate with the bound variable set to x
+double ExpProgram::evaluate(double x) const {
+	vector<double> values(stackSize);
+	int top = 0;
+	for(int i = 0; i < (int)code.size(); i++) {
+		const ProgramOp &instruction = code[i];
+		if(instruction.type == PushConstant) {
+			values[top++] = instruction.constant;
+		}
+		else if(instruction.type == PushVariable) {
+			values[top++] = x;
+		}
+		else if(instruction.type == ApplyFunction) {
+			values[top-1] = (*instruction.func)(values[top-1]);
+		}
+		else {
+			double op2 = values[--top];
+			double &op1 = values[top-1];
+			if(instruction.op == '+') op1 += op2;
+			else if(instruction.op == '-') op1 -= op2;
+			else if(instruction.op == '*') op1 *= op2;
+			else if(instruction.op == '/') op1 /= op2;
+			else op1 = pow(op1, op2);
+		}
+	}
+	return values[0];
+}
+
+// Evaluate value and derivative with the bound variable set to x
+Dual ExpProgram::evaluateDual(double x) const {
+	vector<Dual> values(stackSize);
+	int top = 0;
+	for(int i = 0; i < (int)code.size(); i++) {
+		const ProgramOp &instruction = code[i];
+		if(instruction.type == PushConstant) {
+			values[top++] = Dual(instruction.constant, 0);
+		}
+		else if(instruction.type == PushVariable) {
+			values[top++] = Dual(x, 1);
+		}
+		else if(instruction.type == ApplyFunction) {
+			// Chain rule: f(u)' = f'(u) * u'
+			Dual &u = values[top-1];
+			double deriv = instruction.deriv ? (*instruction.deriv)(u.value) * u.deriv : NAN;
+			u = Dual((*instruction.func)(u.value), deriv);
+		}
+		else {
+			Dual b = values[--top];
+			Dual &a = values[top-1];
+			if(instruction.op == '+') {
+				a = Dual(a.value + b.value, a.deriv + b.deriv);
+			}
+			else if(instruction.op == '-') {
+				a = Dual(a.value - b.value, a.deriv - b.deriv);
+			}
+			else if(instruction.op == '*') {
+				a = Dual(a.value * b.value, a.deriv * b.value + a.value * b.deriv);
+			}
+			else if(instruction.op == '/') {
+				a = Dual(a.value / b.value,
+					(a.deriv * b.value - a.value * b.deriv) / (b.value * b.value));
+			}
+			else {
+				// A constant exponent needs no logarithm, so negative bases work
+				double power = pow(a.value, b.value);
+				double deriv;
+				if(b.deriv == 0) {
+					deriv = a.deriv == 0 ? 0 : b.value * pow(a.value, b.value - 1) * a.deriv;
+				}
+				else {
+					deriv = power * (b.deriv * log(a.value) + b.value * a.deriv / a.value);
+				}
+				a = Dual(power, deriv);
+			}
+		}
+	}
+	return values[0];
+}
+
+// Evaluate in Values, keeping fractions exact like calculateExp
+Value ExpProgram::evaluateExact(const Value &x) const {
+	vector<Value> values(stackSize);
+	int top = 0;
+	for(int i = 0; i < (int)code.size(); i++) {
+		const ProgramOp &instruction = code[i];
+		if(instruction.type == PushConstant) {
+			values[top++] = instruction.exact;
+		}
+		else if(instruction.type == PushVariable) {
+			values[top++] = x;
+		}
+		else if(instruction.type == ApplyFunction) {
+			values[top-1] = values[top-1].applyFunction(instruction.func);
+		}
+		else {
+			Value op2 = values[--top];
+			Value &op1 = values[top-1];
+			if(instruction.op == '+') op1 += op2;
+			else if(instruction.op == '-') op1 -= op2;
+			else if(instruction.op == '*') op1 *= op2;
+			else if(instruction.op == '/') op1 /= op2;
+			else op1.powv(op2);
+		}
+	}
+	return values[0];
+}
+
+// Evaluate for count values of the variable at once
+// Each instruction is a loop over the values, so the stack holds
+// a row of count doubles per level
+void ExpProgram::evaluateBatch(const double *x, double *out, int count, double *stack) const {
+	int top = 0;
+	for(int i = 0; i < (int)code.size(); i++) {
+		const ProgramOp &instruction = code[i];
+		if(instruction.type == PushConstant) {
+			double *row = stack + count * top++;
+			double constant = instruction.constant;
+			for(int j = 0; j < count; j++) row[j] = constant;
+		}
+		else if(instruction.type == PushVariable) {
+			double *row = stack + count * top++;
+			for(int j = 0; j < count; j++) row[j] = x[j];
+		}
+		else if(instruction.type == ApplyFunction) {
+			double *row = stack + count * (top-1);
+			double (*func)(double) = instruction.func;
+			for(int j = 0; j < count; j++) row[j] = (*func)(row[j]);
+		}
+		else {
+			top--;
+			double *op1 = stack + count * (top-1);
+			const double *op2 = stack + count * top;
+			if(instruction.op == '+') {
+				for(int j = 0; j < count; j++) op1[j] += op2[j];
+			}
+			else if(instruction.op == '-') {
+				for(int j = 0; j < count; j++) op1[j] -= op2[j];
+			}
+			else if(instruction.op == '*') {
+				for(int j = 0; j < count; j++) op1[j] *= op2[j];
+			}
+			else if(instruction.op == '/') {
+				for(int j = 0; j < count; j++) op1[j] /= op2[j];
+			}
+			else {
+				for(int j = 0; j < count; j++) op1[j] = pow(op1[j], op2[j]);
+			}
+		}
+	}
+	for(int j = 0; j < count; j++) out[j] = stack[j];
+}
+
+// Whether every function in the program has a known derivative
+bool ExpProgram::isDifferentiable() const {
+	return differentiable;
+}
+
+// Number of instructions
+int ExpProgram::size() const {
+	return code.size();
+}
+
+// Sum ('+') or product ('*') of the program over the variable from
+// first to last
+bool ExpProgram::reduce(char op, long long first, long long last, Value &result,
+	function<bool()> keepGoing) const {
+	result = Value(Fraction(op == '+' ? 0 : 1, 1));
+	if(last < first) return true;
+	
+	long long blockCount = (last - first) / REDUCE_BLOCK + 1;
+	vector<double> partials(blockCount);
+	atomic<bool> stopped(false);
+	
+	// First value of the variable whose term isn't a finite number
+	// Blocks after it are skipped, but every block before it is still
+	// calculated, so the term found doesn't depend on the threads
+	atomic<long long> badTerm(LLONG_MAX);
+	
+	// Every task takes a run of blocks; a block's partial result
+	// doesn't depend on which task calculates it
+	long long taskCount = min(blockCount, (long long)TaskPool::shared().concurrency() * 4);
+	vector<function<void()> > tasks;
+	for(long long t = 0; t < taskCount; t++) {
+		long long blockBegin = blockCount * t / taskCount;
+		long long blockEnd = blockCount * (t+1) / taskCount;
+		tasks.push_back([this, op, first, last, blockBegin, blockEnd,
+			&partials, &stopped, &badTerm, &keepGoing]() {
+			vector<double> x(REDUCE_BATCH), y(REDUCE_BATCH);
+			vector<double> stack(max(stackSize, 1) * REDUCE_BATCH);
+			for(long long b = blockBegin; b < blockEnd; b++) {
+				if(stopped || !keepGoing()) {
+					stopped = true;
+					return;
+				}
+				long long blockFirst = first + b * REDUCE_BLOCK;
+				long long blockLast = min(last, blockFirst + REDUCE_BLOCK - 1);
+				if(blockFirst > badTerm) return;
+				
+				// Kahan summation: compensation keeps the low-order
+				// bits lost by each addition
+				double total = op == '+' ? 0 : 1, compensation = 0;
+				for(long long k = blockFirst; k <= blockLast; k += REDUCE_BATCH) {
+					int count = (int)min((long long)REDUCE_BATCH, blockLast - k + 1);
+					for(int j = 0; j < count; j++) x[j] = (double)(k + j);
+					evaluateBatch(&x[0], &y[0], count, &stack[0]);
+					for(int j = 0; j < count; j++) {
+						// An infinite term would turn the compensation into NaN
+						if(!isfinite(y[j])) {
+							long long known = badTerm;
+							while(k + j < known && !badTerm.compare_exchange_weak(known, k + j)) {}
+							return;
+						}
+						if(op == '+') {
+							double term = y[j] - compensation;
+							double sum = total + term;
+							compensation = (sum - total) - term;
+							total = sum;
+						}
+						else total *= y[j];
+					}
+				}
+				partials[b] = total;
+			}
+		});
+	}
+	TaskPool::shared().runAll(tasks);
+	if(stopped) return false;
+	
+	// Report the error calculateExp gives for that term
+	if(badTerm != LLONG_MAX) {
+		long long k = badTerm;
+		Value x = llabs(k) <= INT_MAX ? Value(Fraction((int)k, 1)) : Value((double)k);
+		if(x.getCalculability() && evaluateExact(x).getCalculability()) {
+			errorStream() << "Arithmatic error: Number too large! ";
+		}
+		result = Value();
+		return true;
+	}
+	
+	// Combine neighbouring partial results until one is left
+	for(long long width = 1; width < blockCount; width *= 2) {
+		for(long long b = 0; b + width < blockCount; b += 2 * width) {
+			if(op == '+') partials[b] += partials[b + width];
+			else partials[b] *= partials[b + width];
+		}
+	}
+	
+	// Value(double) rounds like other results but only takes numbers
+	// with a short integer part; larger ones are kept as they are,
+	// and the caller checks them against the magnitude limit
+	double total = partials[0];
+	if(!isfinite(total) || fabs(total) < REDUCE_ROUNDED_MAX) result = Value(total);
+	else result = Value(Fraction(), total, true, true);
+	return true;
+}
+
+// Sum or product in exact fractions
+bool ExpProgram::reduceExact(char op, long long first, long long last, Value &result,
+	function<bool()> keepGoing) const {
+	if(first < -INT_MAX || last > INT_MAX) return false;
+	long long up = op == '+' ? 0 : 1, down = 1;
+	for(long long k = first; k <= last; k++) {
+		if((k - first) % REDUCE_BLOCK == 0 && !keepGoing()) return false;
+		Value term = evaluateExact(Value(Fraction((int)k, 1)));
+		if(!term.getCalculability()) {
+			result = Value();
+			return true;
+		}
+		if(term.getDecimal() || !combineFraction(op, up, down, term.getFracValue())) return false;
+	}
+	if(llabs(up) > INT_MAX || down > INT_MAX) return false;
+	result = Value(Fraction((int)up, (int)down));
+	return true;
+}
+
+// Find a root in [lo,hi], where the program must change sign
+bool ExpProgram::findRoot(double lo, double hi, double &root,
+	function<bool()> keepGoing) const {
+	// Once keepGoing returns false it isn't asked again, and every
+	// part of the search stops
+	bool stopped = false;
+	function<bool()> evaluating = [&stopped, &keepGoing]() {
+		stopped = stopped || !keepGoing();
+		return !stopped;
+	};
+	
+	if(!evaluating() || !evaluating()) return false;
+	double fLo = evaluate(lo), fHi = evaluate(hi);
+	if(isnan(fLo) || isnan(fHi)) {
+		errorStream() << "Arithmatic error: Expression undefined at the bounds of solve! ";
+		return false;
+	}
+	if(fLo == 0) {
+		root = lo;
+		return true;
+	}
+	if(fHi == 0) {
+		root = hi;
+		return true;
+	}
+	if((fLo > 0) == (fHi > 0)) {
+		errorStream() << "Arithmatic error: No sign change between the bounds of solve! ";
+		return false;
+	}
+	
+	double scale = max(fabs(fLo), fabs(fHi));
+	bool converged = true;
+	if(bracketRoot(lo, hi, scale, root, converged, evaluating)) return true;
+	
+	// The sign change was a jump or a pole; the bounds may still
+	// hold a root between another pair of points
+	double a = lo, fa = fLo;
+	for(int i = 1; i <= ROOT_SCAN_POINTS; i++) {
+		if(!evaluating()) return false;
+		double b = i == ROOT_SCAN_POINTS ? hi : lo + (hi - lo) * i / ROOT_SCAN_POINTS;
+		double fb = evaluate(b);
+		if(fb == 0) {
+			root = b;
+			return true;
+		}
+		if(!isnan(fa) && !isnan(fb) && (fa > 0) != (fb > 0)
+			&& bracketRoot(a, b, scale, root, converged, evaluating)) {
+			return true;
+		}
+		if(stopped) return false;
+		a = b;
+		fa = fb;
+	}
+	if(converged) {
+		errorStream() << "Arithmatic error: No root found between the bounds of solve! ";
+	}
+	else {
+		errorStream() << "Arithmatic error: solve did not converge! ";
+	}
+	return false;
+}
+
+// ********************* //
+// * Private Functions * //
+// ********************* //
+
+// Find the root of a sign change in [lo,hi] and check that it is one;
+// converged is cleared if the method doesn't converge
+bool ExpProgram::bracketRoot(double lo, double hi, double scale, double &root,
+	bool &converged, function<bool()> &keepGoing) const {
+	bool found = differentiable ? newtonRoot(lo, hi, root, keepGoing)
+		: brentRoot(lo, hi, root, keepGoing);
+	if(!found) {
+		converged = false;
+		return false;
+	}
+	
+	// Both methods also close in on a jump or a pole, where the program
+	// changes sign without being zero. Near a root it grows with the
+	// distance from the root; near a jump or a pole it doesn't
+	if(!keepGoing()) return false;
+	double fRoot = fabs(evaluate(root));
+	if(!isfinite(fRoot)) return false;
+	if(fRoot == 0 || fRoot <= ROOT_RESIDUAL * scale) return true;
+	double width = ROOT_CHECK_WIDTH * max(1.0, fabs(root));
+	if(!keepGoing() || !keepGoing()) return false;
+	double nearby = max(fabs(evaluate(max(lo, root - width))),
+		fabs(evaluate(min(hi, root + width))));
+	return isfinite(nearby) && fRoot <= 0.01 * nearby;
+}
+
+// Newton's method, falling back to bisection whenever a step would
+// leave the bracket or not shrink it fast enough
+bool ExpProgram::newtonRoot(double lo, double hi, double &root,
+	function<bool()> &keepGoing) const {
+	// Orient the bracket so that the program is negative at low
+	double low = lo, high = hi;
+	if(!keepGoing()) return false;
+	if(evaluate(lo) > 0) swap(low, high);
+	
+	double x = 0.5 * (lo + hi);
+	double lastStep = fabs(hi - lo), step = lastStep;
+	if(!keepGoing()) return false;
+	Dual fx = evaluateDual(x);
+	for(int i = 0; i < ROOT_MAX_ITERATIONS; i++) {
+		if(isnan(fx.value)) return false;
+		
+		bool outside = ((x - high) * fx.deriv - fx.value) * ((x - low) * fx.deriv - fx.value) > 0;
+		bool slow = fabs(2 * fx.value) > fabs(lastStep * fx.deriv);
+		lastStep = step;
+		if(outside || slow || !isfinite(fx.deriv)) {
+			step = 0.5 * (high - low);
+			x = low + step;
+		}
+		else {
+			step = fx.value / fx.deriv;
+			x -= step;
+		}
+		if(fabs(step) < ROOT_TOLERANCE * max(1.0, fabs(x))) {
+			root = x;
+			return true;
+		}
+		
+		if(!keepGoing()) return false;
+		fx = evaluateDual(x);
+		if(fx.value == 0) {
+			root = x;
+			return true;
+		}
+		if(fx.value < 0) low = x;
+		else high = x;
+	}
+	return false;
+}
+
+// Brent's method: inverse quadratic interpolation and secant steps,
+// falling back to bisection when they don't converge
+bool ExpProgram::brentRoot(double lo, double hi, double &root,
+	function<bool()> &keepGoing) const {
+	if(!keepGoing() || !keepGoing()) return false;
+	double a = lo, b = hi, c = hi;
+	double fa = evaluate(a), fb = evaluate(b), fc = fb;
+	double d = b - a, e = d;
+	for(int i = 0; i < ROOT_MAX_ITERATIONS; i++) {
+		if(isnan(fb)) return false;
+		
+		// Keep the root between b and c, with b the better guess
+		if((fb > 0) == (fc > 0)) {
+			c = a;
+			fc = fa;
+			e = d = b - a;
+		}
+		if(fabs(fc) < fabs(fb)) {
+			a = b; b = c; c = a;
+			fa = fb; fb = fc; fc = fa;
+		}
+		
+		double tolerance = ROOT_TOLERANCE * max(1.0, fabs(b));
+		double middle = 0.5 * (c - b);
+		if(fabs(middle) <= tolerance || fb == 0) {
+			root = b;
+			return true;
+		}
+		
+		if(fabs(e) >= tolerance && fabs(fa) > fabs(fb)) {
+			double s = fb / fa, p, q;
+			if(a == c) {
+				// Secant step
+				p = 2 * middle * s;
+				q = 1 - s;
+			}
+			else {
+				// Inverse quadratic interpolation
+				double r = fb / fc, t = fa / fc;
+				p = s * (2 * middle * t * (t - r) - (b - a) * (r - 1));
+				q = (t - 1) * (r - 1) * (s - 1);
+			}
+			if(p > 0) q = -q;
+			p = fabs(p);
+			
+			// Take the step only if it stays well inside the bracket
+			if(2 * p < min(3 * middle * q - fabs(tolerance * q), fabs(e * q))) {
+				e = d;
+				d = p / q;
+			}
+			else {
+				d = middle;
+				e = d;
+			}
+		}
+		else {
+			d = middle;
+			e = d;
+		}
+		
+		a = b;
+		fa = fb;
+		b += fabs(d) > tolerance ? d : (middle > 0 ? tolerance : -tolerance);
+		if(!keepGoing()) return false;
+		fb = evaluate(b);
+	}
+	return false;
+}
@@ -0,0 +1,131 @@
+/*
+
+exp_program.h
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Header file for ExpProgram, an
+expression compiled for repeated evaluation with
+one bound variable. The program is a postfix list
+of instructions evaluated in doubles (or exactly,
+in Values); variables and constants other than the
+bound one are folded in when it is compiled, so
+evaluating it involves no parsing and no strings.
+Programs can also carry derivatives (dual numbers)
+for root finding, and evaluate many values of the
+variable at once for sums and products.
+
+*/
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "value.h"
+
+using namespace std;
+
+#ifndef EXP_PROGRAM_H
+#define EXP_PROGRAM_H
+
+// A value and its derivative by the bound variable
+struct Dual {
+	double value, deriv;
+	Dual() : value(0), deriv(0) {}
+	Dual(double v, double d) : value(v), deriv(d) {}
+};
+
+enum ProgramOpType {
+	PushConstant, PushVariable, ApplyOperator, ApplyFunction
+};
+
+struct ProgramOp {
+	ProgramOpType type;
+	
+	// Constant as a double and as the Value it came from
+	double constant;
+	Value exact;
+	
+	char op;
+	double (*func)(double);
+	double (*deriv)(double);
+	ProgramOp(ProgramOpType tp) : type(tp), constant(0), op(0), func(NULL), deriv(NULL) {}
+};
+
+class ExpProgram {
+public:
+	
+	// Constructor for an empty program
+	ExpProgram(void);
+	
+	// Append instructions; operands come before their operator
+	void pushConstant(const Value &value);
+	void pushVariable(void);
+	void pushOperator(char op);
+	void pushFunction(double (*func)(double), double (*deriv)(double));
+	
+	// Evaluate with the bound variable set to x
+	double evaluate(double x) const;
+	
+	// Evaluate value and derivative with the bound variable set to x
+	// The derivative is NaN if a function has no known derivative
+	Dual evaluateDual(double x) const;
+	
+	// Evaluate in Values, keeping fractions exact like calculateExp
+	Value evaluateExact(const Value &x) const;
+	
+	// Evaluate for count values of the variable at once; stack must
+	// hold stackSize*count doubles. Instructions run over all values
+	// in simple loops that the compiler can vectorize
+	void evaluateBatch(const double *x, double *out, int count, double *stack) const;
+	
+	// Whether every function in the program has a known derivative
+	bool isDifferentiable(void) const;
+	
+	// Number of instructions
+	int size(void) const;
+	
+	// Sum ('+') or product ('*') of the program over the variable from
+	// first to last; the range is split across threads, and the result
+	// doesn't depend on how many there are
+	// keepGoing is asked now and then; the reduction stops (returning
+	// false) once it returns false. result is not calculable (and the
+	// error is printed) if a term or the result isn't a finite number
+	bool reduce(char op, long long first, long long last, Value &result,
+		function<bool()> keepGoing) const;
+	
+	// Sum or product in exact fractions; returns false if a term
+	// is a decimal, the result doesn't fit in a fraction or keepGoing
+	// returned false. result is not calculable if a term isn't
+	bool reduceExact(char op, long long first, long long last, Value &result,
+		function<bool()> keepGoing) const;
+	
+	// Find a root in [lo,hi], where the program must change sign
+	// Uses Newton steps guarded by bisection when the program is
+	// differentiable, and Brent's method otherwise. If the sign
+	// change is a jump or a pole, other sign changes are tried
+	// Returns false (and prints the reason) if there is none
+	// keepGoing is asked before every evaluation of the program; the
+	// search stops (returning false, printing nothing) once it returns false
+	bool findRoot(double lo, double hi, double &root,
+		function<bool()> keepGoing) const;
+
+private:
+	
+	vector<ProgramOp> code;
+	
+	// Values on the stack after the last instruction, and
+	// the largest number of values on it during evaluation
+	int depth, stackSize;
+	
+	bool differentiable;
+	
+	bool bracketRoot(double lo, double hi, double scale, double &root,
+		bool &converged, function<bool()> &keepGoing) const;
+	bool newtonRoot(double lo, double hi, double &root,
+		function<bool()> &keepGoing) const;
+	bool brentRoot(double lo, double hi, double &root,
+		function<bool()> &keepGoing) const;
+};
+
+#endif
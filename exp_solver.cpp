@@ -17,10 +17,19 @@ strings and solves them.
 #include <math.h>
 #include <ctype.h>
 #include <iomanip>
+#include <sstream>
+#include <functional>
 #include "exp_solver.h"
+#include "task_pool.h"
 
 using namespace std;
 
+// Block ranges smaller than this are always calculated serially
+static const int PARALLEL_MIN_BLOCKS = 4096;
+
+// Blocks of operands that one parallel task calculates at least
+static const int PARALLEL_GRAIN = 1024;
+
 // ******************** //
 // * Public Functions * //
 // ******************** //
@@ -30,8 +39,32 @@ ExpSolver::ExpSolver() {
 	addPredefined();
 }
 
+// Constructor for a session that starts with the variables of base
+ExpSolver::ExpSolver(const Environment &base) : variables(base) {
+	addPredefined();
+}
+
 // Solves expression of input string
 string ExpSolver::solveExp(string exp) {
+	startBudget(true);
+	
+	// Reject expressions over the limits before doing any work
+	LimitError costError = NoLimitError;
+	if(limits.maxInputLength && exp.length() > limits.maxInputLength) {
+		costError = InputTooLong;
+	}
+	else {
+		CostEstimate cost = estimateCost(exp);
+		if(limits.maxTokens && cost.tokens > limits.maxTokens) costError = TooManyTokens;
+		else if(limits.maxDepth && cost.depth > limits.maxDepth) costError = TooDeep;
+		else if(limits.maxOperations && cost.operations > limits.maxOperations) costError = TooExpensive;
+	}
+	if(costError != NoLimitError) {
+		exceedLimit(costError);
+		errorStream() << limitMessage(costError);
+		return "Calculation aborted. ";
+	}
+	
 	// Discard all spaces in the expression
 	exp = discardSpaces(exp);
 	
@@ -46,96 +79,253 @@ string ExpSolver::solveExp(string exp) {
 	
 	// Deal with no right-hand-side input
 	if(exp.length() == 0) {
-		cerr << "Invalid expression! ";
+		errorStream() << "Invalid expression! ";
 		blocks.clear();
 		return "Calculation aborted. ";
 	}
 	
-	// Deal with negative signs in the expression
-	dealWithNegativeSign(exp);
+	// Expand special forms, group the expression into
+	// blocks and recursively solve it
+	Value result = calculateText(exp);
 	
-	// Group the expression into substrings
-	// and calculate the bracket level of each substring
-	bool groupSucceed = groupExp(exp);
-	if(!groupSucceed) {
-		blocks.clear();
+	if(getLimitError() != NoLimitError) {
+		errorStream() << limitMessage(getLimitError());
 		return "Calculation aborted. ";
 	}
 	
-	// Recursively solve the expression
-	Value result = calculateExp(exp, 0, blocks.size());
+	return recordResult(result, isDeclaration, newVarName);
+}
+
+// Save variables and ans to a binary snapshot file
+bool ExpSolver::saveSession(string fileName) {
+	vector<string> names;
+	vector<Value> values;
+	variables.forEach([&names, &values](const string &name, const Value &val) {
+		names.push_back(name);
+		values.push_back(val);
+	});
 	
-	// Create output string
-	string output;
-	if(result.getCalculability()) {
-		// Case: expression includes variable declaration
-		if(isDeclaration) {
-			bool variableCanBeDeclared = true;
-			
-			// Check if there is a constant with the same name
-			for(int i = 0; i < constants.size(); i++) {
-				// If found, then notice name conflict and terminate
-				if(newVarName.compare(constants[i].name) == 0) {
-					variableCanBeDeclared = false;
-					cerr << "Constant \"" << newVarName << "\" cannot be declared! ";
-					blocks.clear();
-					return "Calculation aborted. ";
-				}
+	// Keep snapshot variables that were not redeclared
+	if(baseSession) {
+		for(int i = 0; i < baseSession->size(); i++) {
+			string name = baseSession->nameAt(i);
+			Value shadowing;
+			if(!variables.find(name, shadowing)) {
+				names.push_back(name);
+				values.push_back(baseSession->valueAt(i));
 			}
-			
-			bool variableDeclaredBefore = false;
-			
-			// Find if the variable is already declared
-			for(int i = 0; i < variables.size(); i++) {
-				// If found, redeclare it
-				if(newVarName.compare(variables[i].name) == 0) {
-					variableDeclaredBefore = true;
-					variables[i] = Variable(newVarName, result);
-				}
-			}
-			// If not, push it into the variable stack
-			if(!variableDeclaredBefore) {
-				variables.push_back(Variable(newVarName, result));
-			}
-			cout << newVarName << " = " << result.printValue();
-		}
-		// Case: expression calculation only
-		else {
-			// Record answer for this calculation to support "ans" feature
-			constants[constants.size()-1] = Variable("ans", result);
-			
-			// Create output string
-			output = "Ans = " + result.printValue();
 		}
 	}
-	else {
-		blocks.clear();
-		return "Calculation aborted. ";
-	}
 	
-	// Clean up
-	blocks.clear();
+	return SessionSnapshot::write(fileName, names, values, ans);
+}
+
+// Replace the session state with a snapshot file
+bool ExpSolver::loadSession(string fileName) {
+	SessionSnapshot *snapshot = SessionSnapshot::open(fileName);
+	if(snapshot == NULL) return false;
 	
-	return output;
+	baseSession = shared_ptr<SessionSnapshot>(snapshot);
+	variables = Environment();
+	ans = baseSession->getAns();
+	return true;
+}
+
+// Variables declared in the session (not those of a loaded snapshot)
+const Environment &ExpSolver::getEnvironment() const {
+	return variables;
+}
+
+void ExpSolver::setLimits(const EvalLimits &newLimits) {
+	limits = newLimits;
+}
+
+EvalLimits ExpSolver::getLimits() const {
+	return limits;
+}
+
+// Limit that stopped the last evaluation (NoLimitError if none)
+LimitError ExpSolver::getLimitError() const {
+	return (LimitError)budget.error.load();
+}
+
+// Estimate the cost of an expression before solving it
+// Blocks are counted like groupExp splits them, and every
+// operator and function call is one operation
+CostEstimate ExpSolver::estimateCost(const string &exp) {
+	CostEstimate cost;
+	cost.length = exp.length();
+	int level = 0;
+	BlockType lastType = Nil;
+	for(size_t i = 0; i < exp.length(); i++) {
+		if(isspace(exp[i])) continue;
+		BlockType thisType = charType(exp[i]);
+		
+		bool newToken = (thisType != lastType);
+		newToken |= (thisType == BracL || thisType == BracR || thisType == Sym || thisType == Comma);
+		newToken &= !(thisType == Num && lastType == Func);
+		if(newToken) cost.tokens++;
+		
+		if(thisType == Sym) {
+			cost.operations++;
+		}
+		else if(thisType == BracL) {
+			if(lastType == Func) cost.operations++;
+			level++;
+			cost.depth = max(cost.depth, level);
+		}
+		else if(thisType == BracR) {
+			level--;
+		}
+		lastType = thisType;
+	}
+	return cost;
+}
+
+// Error message of a limit
+string ExpSolver::limitMessage(LimitError error) {
+	switch(error) {
+		case InputTooLong: return "Resource limit: Expression too long! ";
+		case TooManyTokens: return "Resource limit: Too many tokens! ";
+		case TooDeep: return "Resource limit: Brackets nested too deeply! ";
+		case TooExpensive: return "Resource limit: Expression too expensive! ";
+		case TooManyOperations: return "Resource limit: Too many operations! ";
+		case ValueTooLarge: return "Resource limit: Value too large! ";
+		case TimeExceeded: return "Resource limit: Time limit exceeded! ";
+		default: return "";
+	}
 }
 
 // ********************* //
 // * Private Functions * //
 // ********************* //
 
+// Reset the budget for a new evaluation
+void ExpSolver::startBudget(bool timed) {
+	budget.operations = 0;
+	budget.error = NoLimitError;
+	specialResults.clear();
+	budget.timed = timed && limits.maxMillis > 0;
+	if(budget.timed) {
+		budget.deadline = chrono::steady_clock::now() + chrono::milliseconds(limits.maxMillis);
+	}
+}
+
+// Record that a limit was exceeded; the first one is kept
+bool ExpSolver::exceedLimit(LimitError error) {
+	int noError = NoLimitError;
+	budget.error.compare_exchange_strong(noError, error);
+	return false;
+}
+
+// Charge the operation that gave result to the budget; an
+// operation on an array is one operation per element
+bool ExpSolver::charge(const Value &result) {
+	if(!chargeOperations(result.getSize())) return false;
+	
+	// Fractions are big when either part is, even if their value is small
+	if(limits.maxMagnitude > 0 && result.getCalculability()) {
+		if(!(result.getMagnitude() <= limits.maxMagnitude)) return exceedLimit(ValueTooLarge);
+	}
+	return true;
+}
+
+// Charge count operations to the budget
+bool ExpSolver::chargeOperations(long long count) {
+	long long done = budget.operations += count;
+	if(budget.error != NoLimitError) return false;
+	if(limits.maxOperations && done > limits.maxOperations) {
+		return exceedLimit(TooManyOperations);
+	}
+	
+	// Reading the clock costs more than an operation, so only look
+	// each time another 1024 operations have been charged
+	if(done / 1024 != (done - count) / 1024 && outOfTime()) return exceedLimit(TimeExceeded);
+	return true;
+}
+
+// Check whether the time limit of the evaluation has passed
+bool ExpSolver::outOfTime() {
+	return budget.timed && chrono::steady_clock::now() > budget.deadline;
+}
+
+// Apply a binary operator within the budget
+Value ExpSolver::applyOperator(char op, const Value &op1, const Value &op2) {
+	Value result;
+	if(op == '+') result = op1+op2;
+	else if(op == '-') result = op1-op2;
+	else if(op == '*') result = op1*op2;
+	else if(op == '/') result = op1/op2;
+	else if(op == '^') result = powv(op1,op2);
+	if(!charge(result)) return Value();
+	return result;
+}
+
+// Store a calculated result as a variable or as "ans"
+// and create the output string
+string ExpSolver::recordResult(Value result, bool isDeclaration, string newVarName) {
+	if(!result.getCalculability()) {
+		return "Calculation aborted. ";
+	}
+	
+	// Case: expression includes variable declaration
+	if(isDeclaration) {
+		// Check if there is a constant with the same name
+		// If found, then notice name conflict and terminate
+		Value constValue;
+		if(findConstant(newVarName, constValue)) {
+			errorStream() << "Constant \"" << newVarName << "\" cannot be declared! ";
+			return "Calculation aborted. ";
+		}
+		
+		// Declare the variable, or redeclare it if it exists
+		// Only this session's copy of the environment changes
+		variables.set(newVarName, result);
+		return newVarName + " = " + result.printValue();
+	}
+	
+	// Case: expression calculation only
+	// Record answer for this calculation to support "ans" feature
+	ans = result;
+	
+	// Create output string
+	return "Ans = " + result.printValue();
+}
+
+// Derivatives of predefined functions that have no library function
+static double negativeSin(double x) { return -sin(x); }
+static double tanDerivative(double x) { return 1 / (cos(x) * cos(x)); }
+static double sqrtDerivative(double x) { return 0.5 / sqrt(x); }
+static double lnDerivative(double x) { return 1 / x; }
+static double logDerivative(double x) { return 1 / (x * M_LN10); }
+
+// Predefined constants and functions, created once for all sessions
+static vector<Variable> *createConstants() {
+	vector<Variable> *constants = new vector<Variable>();
+	constants->push_back(Variable("e",Value(M_E)));
+	constants->push_back(Variable("pi",Value(M_PI)));
+	return constants;
+}
+
+static vector<Function> *createFunctions() {
+	vector<Function> *functions = new vector<Function>();
+	functions->push_back(Function("sin",sin,cos));
+	functions->push_back(Function("cos",cos,negativeSin));
+	functions->push_back(Function("tan",tan,tanDerivative));
+	functions->push_back(Function("exp",exp,exp));
+	functions->push_back(Function("sqrt",sqrt,sqrtDerivative));
+	functions->push_back(Function("floor",floor));
+	functions->push_back(Function("ln",log,lnDerivative));
+	functions->push_back(Function("log",log10,logDerivative));
+	return functions;
+}
+
 // Add predefined constants and functions
 void ExpSolver::addPredefined() {
-	constants.push_back(Variable("e",Value(M_E)));
-	constants.push_back(Variable("pi",Value(M_PI)));
-	constants.push_back(Variable("ans",Value()));
-	functions.push_back(Function("sin",sin));
-	functions.push_back(Function("cos",cos));
-	functions.push_back(Function("tan",tan));
-	functions.push_back(Function("exp",exp));
-	functions.push_back(Function("sqrt",sqrt));
-	functions.push_back(Function("floor",floor));
-	functions.push_back(Function("ln",log));
-	functions.push_back(Function("log",log10));
+	static shared_ptr<const vector<Variable> > sharedConstants(createConstants());
+	static shared_ptr<const vector<Function> > sharedFunctions(createFunctions());
+	constants = sharedConstants;
+	functions = sharedFunctions;
 }
 
 // Discard spaces in the input string
@@ -161,18 +351,18 @@ bool ExpSolver::checkDeclaration(string &exp, string &newVarName, bool &isDec) {
 		
 		// Check if more than one '=' exists
 		if(exp.find('=') != string::npos) {
-			cerr << "Syntax error: Too many '='! ";
+			errorStream() << "Syntax error: Too many '='! ";
 			return false;
 		}
 		
 		// Check variable name validity
 		if(newVarName.length() == 0 || !isalpha(newVarName[0])) {
-			cerr << "Variable name invalid! ";
+			errorStream() << "Variable name invalid! ";
 			return false;
 		}
 		for(int i = 1; i < newVarName.length(); i++) {
 			if(!(isalnum(newVarName[i]) || newVarName[i] == '_')) {
-				cerr << "Variable name invalid! ";
+				errorStream() << "Variable name invalid! ";
 				return false;
 			}
 		}
@@ -194,8 +384,18 @@ bool ExpSolver::groupExp(string exp) {
 	// Record type of the last character
 	BlockType currentType = Nil;
 	
+	// Brackets that are open, to check that '(' is closed by ')'
+	// and '[' by ']'
+	string openBrackets;
+	bool bracketsPaired = true;
 	
 	for(int i = 0; i <= exp.length(); i++) {
+		// Grouping a long expression takes time too
+		if(i % 4096 == 4095 && outOfTime()) {
+			exceedLimit(TimeExceeded);
+			return false;
+		}
+		
 		// Record type of the just inspected character
 		BlockType thisType = charType(exp[i]);
 		
@@ -204,6 +404,7 @@ bool ExpSolver::groupExp(string exp) {
 		needNewBlock |= (currentType == BracL);
 		needNewBlock |= (currentType == BracR);
 		needNewBlock |= (currentType == Sym);
+		needNewBlock |= (currentType == Comma);
 		needNewBlock |= (thisType != currentType);
 		needNewBlock |= (i == exp.length());
 		needNewBlock &= !(thisType == Num && currentType == Func);
@@ -231,13 +432,20 @@ bool ExpSolver::groupExp(string exp) {
 		}
 		
 		// Upper level before left brackets are pushed into stack
-		if(thisType == BracL) level++;
+		if(thisType == BracL) {
+			level++;
+			openBrackets += exp[i];
+		}
+		else if(thisType == BracR && !openBrackets.empty()) {
+			bracketsPaired &= (openBrackets[openBrackets.length()-1] == '(') == (exp[i] == ')');
+			openBrackets.erase(openBrackets.length()-1);
+		}
 	}
 	
 	// Throw error if brackets are not paired
 	// (diagonized by inspecting variable level)
-	if(level != 0) {
-		cerr << "Syntax error: Brackets not paired! ";
+	if(level != 0 || !bracketsPaired) {
+		errorStream() << "Syntax error: Brackets not paired! ";
 		return false;
 	}
 	
@@ -246,49 +454,429 @@ bool ExpSolver::groupExp(string exp) {
 
 // Analyze whether a string Block is of BlockType Func, Constant or Var
 BlockType ExpSolver::analyzeStrType(string str) {
-	for(int i = 0; i < functions.size(); i++) {
-		if(str.compare(functions[i].name) == 0) return Func;
+	if(boundVariable.length() > 0 && str.compare(boundVariable) == 0) return Var;
+	for(int i = 0; i < functions->size(); i++) {
+		if(str.compare((*functions)[i].name) == 0) return Func;
 	}
-	for(int i = 0; i < constants.size(); i++) {
-		if(str.compare(constants[i].name) == 0) return Constant;
+	Value val;
+	if(findConstant(str, val)) return Constant;
+	if(findVariable(str, val)) return Var;
+	errorStream() << "String \"" + str + "\" not recognized! ";
+	return Nil;
+}
+
+// Look up a constant (including "ans") by name
+bool ExpSolver::findConstant(const string &name, Value &val) {
+	for(int i = 0; i < constants->size(); i++) {
+		if(name.compare((*constants)[i].name) == 0) {
+			val = (*constants)[i].value;
+			return true;
+		}
 	}
-	for(int i = 0; i < variables.size(); i++) {
-		if(str.compare(variables[i].name) == 0) return Var;
+	if(name.compare("ans") == 0) {
+		val = ans;
+		return true;
 	}
-	cerr << "String \"" + str + "\" not recognized! ";
-	return Nil;
+	return false;
+}
+
+// Look up a user-defined variable by name
+bool ExpSolver::findVariable(const string &name, Value &val) {
+	if(name.length() > 1 && name[0] == '_') {
+		size_t index = strtoul(name.c_str() + 1, NULL, 10);
+		if(index >= specialResults.size()) return false;
+		val = specialResults[index];
+		return true;
+	}
+	if(variables.find(name, val)) return true;
+	
+	// Fall back to the variables of a loaded snapshot
+	if(baseSession) return baseSession->find(name, val);
+	
+	return false;
 }
 
 // Determine the type of one single character
 BlockType ExpSolver::charType(char c) {
 	if(c == '_' || isalpha(c)) return Func;
 	else if(c == '.' || isdigit(c)) return Num;
-	else if(c == '(') return BracL;
-	else if(c == ')') return BracR;
+	else if(c == '(' || c == '[') return BracL;
+	else if(c == ')' || c == ']') return BracR;
 	else if(c == '+' || c == '-' || c == '*' || c == '/' || c == '^') return Sym;
+	else if(c == ',') return Comma;
 	else return Nil;
 }
 
 // Replace every "-" as negative sign by "0-"
-void ExpSolver::dealWithNegativeSign(string &exp) {
-	if(exp.length() > 0 && exp[0] == '-') {
-		exp = '0' + exp;
+// A negative sign may also start an element of an array
+// The result is built in one pass, so long expressions stay cheap;
+// returns false if the time limit passes meanwhile
+bool ExpSolver::dealWithNegativeSign(string &exp) {
+	string newExp;
+	newExp.reserve(exp.length() + exp.length() / 2 + 1);
+	for(size_t i = 0; i < exp.length(); i++) {
+		if(i % 4096 == 4095 && outOfTime()) {
+			exceedLimit(TimeExceeded);
+			return false;
+		}
+		if(exp[i] == '-' && (i == 0 || exp[i-1] == '(' || exp[i-1] == '[' || exp[i-1] == ',')) {
+			newExp += '0';
+		}
+		newExp += exp[i];
 	}
-	for(int i = 1; i < exp.length(); i++) {
-		if(exp[i] == '-' && exp[i-1] == '(') {
-			exp = exp.substr(0,i) + '0' + exp.substr(i);
+	exp.swap(newExp);
+	return true;
+}
+
+// Replace special forms such as solve(expr, var, lo, hi) and
+// sum(var, lo, hi, expr) in an expression without spaces by their results
+bool ExpSolver::expandSpecialForms(string &exp) {
+	for(int i = 0; i < (int)exp.length(); i++) {
+		if(charType(exp[i]) != Func) continue;
+		
+		// Read a whole name, which may contain digits
+		int nameEnd = i;
+		while(nameEnd < (int)exp.length() && (charType(exp[nameEnd]) == Func
+			|| charType(exp[nameEnd]) == Num)) nameEnd++;
+		string name = exp.substr(i, nameEnd-i);
+		
+		// Only results of special forms have names starting with '_'
+		if(name[0] == '_') {
+			errorStream() << "String \"" + name + "\" not recognized! ";
+			return false;
+		}
+		bool special = name.compare("solve") == 0 || name.compare("sum") == 0
+			|| name.compare("prod") == 0;
+		if(!special || nameEnd == (int)exp.length() || exp[nameEnd] != '(') {
+			i = nameEnd - 1;
+			continue;
+		}
+		
+		// Split the arguments at commas outside inner brackets
+		vector<string> args;
+		int level = 0, argStart = nameEnd + 1, end = nameEnd;
+		for(; end < (int)exp.length(); end++) {
+			if(charType(exp[end]) == BracL) level++;
+			else if(charType(exp[end]) == BracR) level--;
+			if((exp[end] == ',' && level == 1) || level == 0) {
+				args.push_back(exp.substr(argStart, end-argStart));
+				argStart = end + 1;
+			}
+			if(level == 0) break;
+		}
+		if(level != 0) {
+			errorStream() << "Syntax error: Brackets not paired! ";
+			return false;
 		}
+		
+		Value result = calculateSpecialForm(name, args);
+		if(!result.getCalculability()) return false;
+		
+		// Refer to the result by name, so that it keeps its precision
+		// and stays one operand
+		string resultName = "_" + to_string(specialResults.size());
+		specialResults.push_back(result);
+		exp.replace(i, end+1-i, resultName);
+		i += resultName.length() - 1;
+	}
+	return true;
+}
+
+// Calculate the special form name with arguments args
+Value ExpSolver::calculateSpecialForm(const string &name, const vector<string> &args) {
+	bool exact = args.size() == 5 && args[4].compare("exact") == 0;
+	if(name.compare("solve") == 0 ? args.size() != 4 : args.size() != 4 && !exact) {
+		errorStream() << "Syntax error: " << name << " needs 4 arguments! ";
+		return Value();
+	}
+	if(name.compare("solve") == 0) return calculateSolve(args);
+	return calculateReduction(name.compare("sum") == 0 ? '+' : '*', args, exact);
+}
+
+// Check that var can be bound by a special form
+bool ExpSolver::checkBoundVariable(const string &var) {
+	Value unused;
+	bool nameValid = var.length() > 0 && isalpha(var[0]) && !findConstant(var, unused);
+	for(int i = 1; i < (int)var.length(); i++) {
+		nameValid &= (isalnum(var[i]) || var[i] == '_');
 	}
+	for(int i = 0; i < (int)functions->size(); i++) {
+		nameValid &= (var.compare((*functions)[i].name) != 0);
+	}
+	if(!nameValid) errorStream() << "Variable name invalid! ";
+	return nameValid;
+}
+
+// solve(expr, var, lo, hi): root of expr in variable var between lo and hi
+Value ExpSolver::calculateSolve(const vector<string> &args) {
+	const string &var = args[1];
+	if(!checkBoundVariable(var)) return Value();
+	
+	Value lo = calculateText(args[2]);
+	if(!lo.getCalculability()) return Value();
+	Value hi = calculateText(args[3]);
+	if(!hi.getCalculability()) return Value();
+	if(lo.isArray() || hi.isArray()) {
+		errorStream() << "Arithmatic error: Bounds of solve must be numbers! ";
+		return Value();
+	}
+	
+	ExpProgram program;
+	if(!compileExp(args[0], var, program)) return Value();
+	// Every evaluation runs the whole program
+	long long size = program.size();
+	function<bool()> keepGoing = [this, size]() {
+		return chargeOperations(size);
+	};
+	double root;
+	if(!program.findRoot(lo.getDecValue(), hi.getDecValue(), root, keepGoing)) return Value();
+	return Value(root);
+}
+
+// sum(var, lo, hi, expr) and prod(var, lo, hi, expr): sum ('+') or
+// product ('*') of expr over the integers var from lo to hi
+// With a fifth argument "exact" fractions are added up exactly,
+// as long as every term is a fraction and the result fits in one
+Value ExpSolver::calculateReduction(char op, const vector<string> &args, bool exact) {
+	const string &var = args[0];
+	if(!checkBoundVariable(var)) return Value();
+	
+	Value lo = calculateText(args[1]);
+	if(!lo.getCalculability()) return Value();
+	Value hi = calculateText(args[2]);
+	if(!hi.getCalculability()) return Value();
+	if(lo.isArray() || lo.getDecimal() || lo.getFracValue().down != 1
+		|| hi.isArray() || hi.getDecimal() || hi.getFracValue().down != 1) {
+		errorStream() << "Arithmatic error: Bounds of " << (op == '+' ? "sum" : "prod")
+			<< " must be integers! ";
+		return Value();
+	}
+	long long first = lo.getFracValue().up, last = hi.getFracValue().up;
+	
+	ExpProgram program;
+	if(!compileExp(args[3], var, program)) return Value();
+	
+	// Every iteration runs the whole program, so charge it all at once
+	long long iterations = max(last - first + 1, 0LL);
+	if(limits.maxOperations && iterations > limits.maxOperations / program.size()) {
+		exceedLimit(TooManyOperations);
+		return Value();
+	}
+	budget.operations += iterations * program.size();
+	if(limits.maxOperations && budget.operations > limits.maxOperations) {
+		exceedLimit(TooManyOperations);
+		return Value();
+	}
+	
+	function<bool()> keepGoing = [this]() {
+		return !outOfTime();
+	};
+	Value result;
+	if(!exact || !program.reduceExact(op, first, last, result, keepGoing)) {
+		if(!program.reduce(op, first, last, result, keepGoing)) {
+			exceedLimit(TimeExceeded);
+			return Value();
+		}
+	}
+	if(!result.getCalculability()) return Value();
+	if(!charge(result)) return Value();
+	return result;
+}
+
+// Calculate an expression without spaces that is part of a larger
+// one, keeping the blocks of the caller
+Value ExpSolver::calculateText(string exp) {
+	// Preparing a long expression takes time too
+	if(outOfTime()) {
+		exceedLimit(TimeExceeded);
+		return Value();
+	}
+	if(!expandSpecialForms(exp)) return Value();
+	if(exp.length() == 0) {
+		errorStream() << "Invalid expression! ";
+		return Value();
+	}
+	
+	// Deal with negative signs in the expression
+	if(!dealWithNegativeSign(exp)) return Value();
+	
+	vector<Block> callerBlocks;
+	callerBlocks.swap(blocks);
+	
+	// Group the expression into substrings
+	// and calculate the bracket level of each substring
+	Value result;
+	if(groupExp(exp)) {
+		// Recursively solve the expression
+		result = calculateExp(exp, 0, blocks.size());
+	}
+	
+	blocks.swap(callerBlocks);
+	return result;
+}
+
+// Compile an expression without spaces into a program of variable var
+// Operators are ordered like calculateExp does: '^' before '*' '/'
+// before '+' '-', and operators of equal priority from the left
+bool ExpSolver::compileExp(string exp, const string &var, ExpProgram &program) {
+	if(outOfTime()) return exceedLimit(TimeExceeded);
+	if(!expandSpecialForms(exp)) return false;
+	if(exp.length() == 0) {
+		errorStream() << "Invalid expression! ";
+		return false;
+	}
+	if(!dealWithNegativeSign(exp)) return false;
+	
+	vector<Block> callerBlocks;
+	callerBlocks.swap(blocks);
+	boundVariable = var;
+	bool compiled = groupExp(exp);
+	boundVariable = "";
+	
+	// Operator stack; brackets remember the function applied
+	// to them (-1 for none)
+	vector<char> ops;
+	vector<int> bracketFuncs;
+	int pendingFunc = -1;
+	bool expectOperand = true;
+	for(int i = 0; compiled && i < (int)blocks.size(); i++) {
+		string blockStr = exp.substr(blocks[i].start, blocks[i].end-blocks[i].start);
+		BlockType type = blocks[i].type;
+		
+		// Operands
+		if(type == Num || type == Constant || type == Var) {
+			Value val;
+			if(type == Num) val = Value(blockStr);
+			else if(type == Constant) {
+				findConstant(blockStr, val);
+				if(!val.getCalculability()) {
+					errorStream() << "Bad access: \"ans\" not defined currently! ";
+				}
+			}
+			else if(blockStr.compare(var) != 0) findVariable(blockStr, val);
+			
+			if(!expectOperand) {
+				errorStream() << "Invalid expression! ";
+				compiled = false;
+			}
+			else if(type == Var && blockStr.compare(var) == 0) {
+				program.pushVariable();
+			}
+			else if(!val.getCalculability()) {
+				compiled = false;
+			}
+			else if(val.isArray()) {
+				errorStream() << "Arithmatic error: Arrays can't be used in sum, prod or solve! ";
+				compiled = false;
+			}
+			else {
+				program.pushConstant(val);
+			}
+			expectOperand = false;
+		}
+		
+		else if(type == Func) {
+			if(i+1 == (int)blocks.size() || blocks[i+1].type != BracL) {
+				errorStream() << "Syntax Error: Need brackets after function name! ";
+				compiled = false;
+			}
+			for(int f = 0; f < (int)functions->size(); f++) {
+				if(blockStr.compare((*functions)[f].name) == 0) pendingFunc = f;
+			}
+		}
+		
+		else if(type == BracL) {
+			if(!expectOperand) {
+				errorStream() << "Invalid expression! ";
+				compiled = false;
+			}
+			if(blockStr[0] == '[') {
+				errorStream() << "Arithmatic error: Arrays can't be used in sum, prod or solve! ";
+				compiled = false;
+				break;
+			}
+			ops.push_back('(');
+			bracketFuncs.push_back(pendingFunc);
+			pendingFunc = -1;
+		}
+		
+		else if(type == BracR) {
+			if(expectOperand) {
+				errorStream() << "Invalid expression! ";
+				compiled = false;
+				break;
+			}
+			while(!ops.empty() && ops.back() != '(') {
+				program.pushOperator(ops.back());
+				ops.pop_back();
+			}
+			if(ops.empty()) {
+				errorStream() << "Syntax error: Brackets not paired! ";
+				compiled = false;
+				break;
+			}
+			ops.pop_back();
+			int func = bracketFuncs.back();
+			bracketFuncs.pop_back();
+			if(func >= 0) program.pushFunction((*functions)[func].func, (*functions)[func].deriv);
+		}
+		
+		else if(type == Sym) {
+			if(expectOperand) {
+				errorStream() << "Invalid expression! ";
+				compiled = false;
+				break;
+			}
+			char op = blockStr[0];
+			int priority = op == '^' ? 3 : (op == '*' || op == '/') ? 2 : 1;
+			while(!ops.empty() && ops.back() != '(') {
+				char lastOp = ops.back();
+				int lastPriority = lastOp == '^' ? 3 : (lastOp == '*' || lastOp == '/') ? 2 : 1;
+				if(lastPriority < priority) break;
+				program.pushOperator(lastOp);
+				ops.pop_back();
+			}
+			ops.push_back(op);
+			expectOperand = true;
+		}
+		
+		else {
+			errorStream() << "Encountered unknown character! ";
+			compiled = false;
+		}
+	}
+	if(compiled && expectOperand) {
+		errorStream() << "Invalid expression! ";
+		compiled = false;
+	}
+	while(compiled && !ops.empty()) {
+		program.pushOperator(ops.back());
+		ops.pop_back();
+	}
+	
+	blocks.swap(callerBlocks);
+	return compiled;
 }
 
 // Calculate expression in block range [startBlock,endBlock)
-Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
+Value ExpSolver::calculateExp(const string &exp, int startBlock, int endBlock) {
+	
+	// Split large ranges into operands that are calculated in parallel
+	if(endBlock - startBlock >= PARALLEL_MIN_BLOCKS) {
+		Value parallelResult;
+		if(calculateParallel(exp, startBlock, endBlock, parallelResult)) {
+			return parallelResult;
+		}
+	}
 	
 	// Create stacks that stores operands and operators
 	stack<Value> values;
 	stack<char> ops;
 	
 	for(int i = endBlock-1; i >= startBlock; i--) {
+		// Give up once any part of the evaluation ran out of budget
+		if(budget.error != NoLimitError) return Value();
+		
 		// Record the content of the current block
 		string blockStr = exp.substr(blocks[i].start,blocks[i].end-blocks[i].start);
 		
@@ -304,26 +892,20 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 		
 		// Throw error if function names occur without brackets
 		else if(blocks[i].type == Func) {
-			cerr << "Syntax Error: Need brackets after function name! ";
+			errorStream() << "Syntax Error: Need brackets after function name! ";
 			return Value();
 		}
 		
 		// Replace constants with Value
 		else if(blocks[i].type == Constant) {
 			Value constValue;
-			for(int i = 0; i < constants.size(); i++) {
-				if(blockStr.compare(constants[i].name) == 0) {
-					constValue = constants[i].value;
-					
-					// If constant doesn't have a value
-					// that means that 'ans' is not defined
-					if(!constValue.getCalculability()) {
-						cerr << "Bad access: \"ans\" not defined currently! ";
-						return Value();
-					}
-					
-					break;
-				}
+			findConstant(blockStr, constValue);
+			
+			// If constant doesn't have a value
+			// that means that 'ans' is not defined
+			if(!constValue.getCalculability()) {
+				errorStream() << "Bad access: \"ans\" not defined currently! ";
+				return Value();
 			}
 			values.push(constValue);
 		}
@@ -331,12 +913,7 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 		// Replace values with Value
 		else if(blocks[i].type == Var) {
 			Value varValue;
-			for(int i = 0; i < variables.size(); i++) {
-				if(blockStr.compare(variables[i].name) == 0) {
-					varValue = variables[i].value;
-					break;
-				}
-			}
+			findVariable(blockStr, varValue);
 			values.push(varValue);
 		}
 		
@@ -345,14 +922,33 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 		else if(blocks[i].type == BracR) {
 			// Corresponding Block ID
 			int corBlock = findIndexOfBracketEnding(i);
-			if(corBlock != 0 && blocks[corBlock-1].type == Func) {
+			if(blockStr[0] == ']') {
+				// Array: calculate the elements between the commas
+				// directly inside the brackets
+				vector<Value> elements;
+				int elementStart = corBlock+1;
+				for(int j = corBlock+1; j <= i; j++) {
+					if(j < i && !(blocks[j].type == Comma && blocks[j].level == blocks[i].level)) continue;
+					Value element = calculateExp(exp, elementStart, j);
+					if(!element.getCalculability()) {
+						return Value();
+					}
+					elements.push_back(element);
+					elementStart = j+1;
+				}
+				Value arrayValue = Value(elements);
+				if(!arrayValue.getCalculability() || !charge(arrayValue)) return Value();
+				values.push(arrayValue);
+				iIncrement -= i - corBlock;
+			}
+			else if(corBlock != 0 && blocks[corBlock-1].type == Func) {
 				// Find the function and calculate the result of the function.
 				double (*funcToUse)(double);
 				string funcName = exp.substr(blocks[corBlock-1].start, 
 					blocks[corBlock-1].end-blocks[corBlock-1].start);
-				for(int i = 0; i < functions.size(); i++) {
-					if(funcName.compare(functions[i].name) == 0) {
-						funcToUse = functions[i].func;
+				for(int i = 0; i < functions->size(); i++) {
+					if(funcName.compare((*functions)[i].name) == 0) {
+						funcToUse = (*functions)[i].func;
 						break;
 					}
 				}
@@ -360,14 +956,11 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 				if(!valueInFunc.getCalculability()) {
 					return Value();
 				}
-				else if(valueInFunc.getDecValue() < 0 && funcName.compare("sqrt") == 0) {
-					cerr << "Arithmatic error: Cannot square root a negative number! ";
-					return Value();
-				}
-				double funcResult = (*funcToUse)(valueInFunc.getDecValue());
 				
-				// Convert to Value and push to stack.
-				Value newValue = Value(funcResult);
+				// Apply the function (to every element of an array)
+				// and push the result to stack.
+				Value newValue = valueInFunc.applyFunction(funcToUse);
+				if(!newValue.getCalculability() || !charge(newValue)) return Value();
 				values.push(newValue);
 				
 				iIncrement -= i - corBlock + 1;
@@ -389,7 +982,7 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 			// Here '^' can be calculated
 			if(blockStr[0] == '*' || blockStr[0] == '/') {
 				if(values.size() != ops.size()+1) {
-					cerr << "Invalid expression! ";
+					errorStream() << "Invalid expression! ";
 					return Value();
 				}
 				while(!ops.empty()) {
@@ -398,7 +991,7 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 						ops.pop();
 						Value op1 = values.top(); values.pop();
 						Value op2 = values.top(); values.pop();
-						values.push(powv(op1,op2));
+						values.push(applyOperator(lastOp,op1,op2));
 					}
 					else {
 						break;
@@ -410,7 +1003,7 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 			// Here '^' '*' '/' can be calculated
 			else if(blockStr[0] == '+' || blockStr[0] == '-') {
 				if(values.size() != ops.size()+1) {
-					cerr << "Invalid expression! ";
+					errorStream() << "Invalid expression! ";
 					return Value();
 				}
 				while(!ops.empty()) {
@@ -419,9 +1012,7 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 						ops.pop();
 						Value op1 = values.top(); values.pop();
 						Value op2 = values.top(); values.pop();
-						if(lastOp == '*') values.push(op1*op2);
-						else if(lastOp == '/') values.push(op1/op2);
-						else if(lastOp == '^') values.push(powv(op1,op2));
+						values.push(applyOperator(lastOp,op1,op2));
 					}
 					else {
 						break;
@@ -431,7 +1022,7 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 			ops.push(blockStr[0]);
 		}
 		else {
-			cerr << "Encountered unknown character! ";
+			errorStream() << "Encountered unknown character! ";
 			return Value();
 		}
 		
@@ -440,7 +1031,7 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 	
 	// Final calculation not containing any bracket
 	if(values.size() != ops.size()+1) {
-		cerr << "Invalid expression! ";
+		errorStream() << "Invalid expression! ";
 		return Value();
 	}
 	while(!ops.empty()) {
@@ -448,14 +1039,10 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 		ops.pop();
 		Value op1 = values.top(); values.pop();
 		Value op2 = values.top(); values.pop();
-		if(lastOp == '+') values.push(op1+op2);
-		else if(lastOp == '-') values.push(op1-op2);
-		else if(lastOp == '*') values.push(op1*op2);
-		else if(lastOp == '/') values.push(op1/op2);
-		else if(lastOp == '^') values.push(powv(op1,op2));
+		values.push(applyOperator(lastOp,op1,op2));
 	}
 	if(values.size() > 1) {
-		cerr << "Invalid expression! ";
+		errorStream() << "Invalid expression! ";
 		return Value();
 	}
 	
@@ -469,6 +1056,80 @@ Value ExpSolver::calculateExp(string exp, int startBlock, int endBlock) {
 	return returnValue;
 }
 
+// Calculate a large block range by evaluating its top-level
+// operands in parallel; returns false if the range can't be split
+bool ExpSolver::calculateParallel(const string &exp, int startBlock, int endBlock, Value &result) {
+	// Split at top-level '+' '-', or at '*' '/' if there are none
+	// Operators that bind tighter stay inside the operands
+	vector<int> splits;
+	for(int pass = 0; pass < 2 && splits.empty(); pass++) {
+		int depth = 0;
+		for(int i = startBlock; i < endBlock; i++) {
+			if(blocks[i].type == BracL) depth++;
+			else if(blocks[i].type == BracR) depth--;
+			if(blocks[i].type != Sym || depth != 0) continue;
+			char op = exp[blocks[i].start];
+			if((pass == 0 && (op == '+' || op == '-'))
+				|| (pass == 1 && (op == '*' || op == '/'))) {
+				splits.push_back(i);
+			}
+		}
+	}
+	if(splits.empty()) return false;
+	
+	// Operand k is the block range [operandStart[k],operandEnd[k])
+	int operandCount = splits.size() + 1;
+	vector<int> operandStart(operandCount), operandEnd(operandCount);
+	operandStart[0] = startBlock;
+	for(int k = 0; k < (int)splits.size(); k++) {
+		operandEnd[k] = splits[k];
+		operandStart[k+1] = splits[k] + 1;
+	}
+	operandEnd[operandCount-1] = endBlock;
+	
+	// Group neighbouring operands into tasks of at least PARALLEL_GRAIN
+	// blocks; each operand is still calculated on its own
+	vector<Value> operands(operandCount);
+	vector<string> errors(operandCount);
+	vector<function<void()> > tasks;
+	int first = 0, size = 0;
+	for(int k = 0; k < operandCount; k++) {
+		size += operandEnd[k] - operandStart[k];
+		if(size < PARALLEL_GRAIN && k != operandCount-1) continue;
+		int last = k;
+		tasks.push_back([this, &exp, &operands, &errors,
+				&operandStart, &operandEnd, first, last]() {
+			ostream *callerStream = &errorStream();
+			for(int j = first; j <= last; j++) {
+				ostringstream operandErrors;
+				setErrorStream(&operandErrors);
+				operands[j] = calculateExp(exp, operandStart[j], operandEnd[j]);
+				errors[j] = operandErrors.str();
+			}
+			setErrorStream(callerStream);
+		});
+		first = k + 1;
+		size = 0;
+	}
+	if(tasks.size() < 2) return false;
+	TaskPool::shared().runAll(tasks);
+	
+	// Report errors right to left like a serial pass, which
+	// mostly gives up at the first operand that fails
+	for(int k = operandCount-1; k >= 0; k--) {
+		errorStream() << errors[k];
+		if(!operands[k].getCalculability()) break;
+	}
+	
+	// Combine from the left like the serial calculation does,
+	// so results (including rounding) are identical
+	result = operands[0];
+	for(int k = 1; k < operandCount && budget.error == NoLimitError; k++) {
+		result = applyOperator(exp[blocks[splits[k-1]].start], result, operands[k]);
+	}
+	return true;
+}
+
 // Given the block id of ')', find the block id of corresponding '('
 int ExpSolver::findIndexOfBracketEnding(int blockId) { 
 	int levelToFind = blocks[blockId].level-1, currentBlockId = blockId;
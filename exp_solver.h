@@ -14,7 +14,13 @@ and solves them.
 #include <string>
 #include <vector>
 #include <stack>
+#include <memory>
+#include <atomic>
+#include <chrono>
 #include "value.h"
+#include "snapshot.h"
+#include "environment.h"
+#include "exp_program.h"
 
 using namespace std;
 
@@ -31,12 +37,16 @@ struct Variable {
 struct Function {
 	string name;
 	double (*func)(double);
-	Function(string nm, double (*f)(double))
-		: name(nm), func(f) {}
+	
+	// Derivative of func, NULL if it has none (used by solve)
+	double (*deriv)(double);
+	
+	Function(string nm, double (*f)(double), double (*d)(double) = NULL)
+		: name(nm), func(f), deriv(d) {}
 };
 
 enum BlockType {
-	Num, Sym, Func, Constant, Var, BracL, BracR, Nil
+	Num, Sym, Func, Constant, Var, BracL, BracR, Comma, Nil
 };
 
 struct Block {
@@ -47,26 +57,154 @@ struct Block {
 		: start(s), end(e), level(l), type(tp) {}
 };
 
+// Limits on the resources one evaluation may use; 0 means no limit
+// The defaults leave room for any sensible input while keeping
+// the recursion of calculateExp well inside a thread's stack
+struct EvalLimits {
+	// Characters of the expression and blocks it is split into
+	size_t maxInputLength, maxTokens;
+	
+	// Nesting of brackets
+	int maxDepth;
+	
+	// Operators and functions applied
+	long long maxOperations;
+	
+	// Absolute value of any intermediate result
+	double maxMagnitude;
+	
+	// Wall-clock time of the calculation
+	int maxMillis;
+	
+	EvalLimits()
+		: maxInputLength(1 << 26), maxTokens(1 << 24), maxDepth(1000),
+		maxOperations(1LL << 26), maxMagnitude(1e300), maxMillis(10000) {}
+};
+
+// Limit that stopped an evaluation
+enum LimitError {
+	NoLimitError, InputTooLong, TooManyTokens, TooDeep,
+	TooExpensive, TooManyOperations, ValueTooLarge, TimeExceeded
+};
+
+// Cost of an expression, estimated from its text without evaluating it
+struct CostEstimate {
+	size_t length, tokens;
+	int depth;
+	long long operations;
+	CostEstimate() : length(0), tokens(0), depth(0), operations(0) {}
+};
+
+// Budget of the evaluation in progress; the parallel operand
+// tasks of an evaluation draw from it concurrently
+struct EvalBudget {
+	atomic<long long> operations;
+	atomic<int> error;
+	bool timed;
+	chrono::steady_clock::time_point deadline;
+	EvalBudget() : operations(0), error(NoLimitError), timed(false) {}
+	
+	// A budget only lives for one evaluation, so copies start afresh
+	EvalBudget(const EvalBudget &) : operations(0), error(NoLimitError), timed(false) {}
+	EvalBudget &operator=(const EvalBudget &) { return *this; }
+};
+
 class ExpSolver {
 public:
 	
 	// Constructor to initialize the ExpSolver object
 	ExpSolver(void);
 	
+	// Constructor for a session that starts with the variables of base
+	// Like copying an ExpSolver, this is O(1): the variables are shared
+	// until one of the sessions declares a variable
+	ExpSolver(const Environment &base);
+	
 	// Inputs a string of expression and outputs the result 
 	string solveExp(string);
 	
+	// Save variables and ans to a binary snapshot file
+	bool saveSession(string fileName);
+	
+	// Replace the session state with a snapshot file
+	// The file is mapped and read in place instead of being replayed
+	bool loadSession(string fileName);
+	
+	// Variables declared in the session (not those of a loaded snapshot)
+	const Environment &getEnvironment(void) const;
+	
+	// Resource limits applied to every evaluation
+	void setLimits(const EvalLimits &newLimits);
+	EvalLimits getLimits(void) const;
+	
+	// Limit that stopped the last evaluation (NoLimitError if none)
+	LimitError getLimitError(void) const;
+	
+	// Estimate the cost of an expression before solving it, so that
+	// callers can reject or route expensive expressions
+	static CostEstimate estimateCost(const string &exp);
+	
+	// Error message of a limit
+	static string limitMessage(LimitError error);
+
 private:
 	
+	// Streams calculate with the variables of the solver
+	friend class ExpStream;
+	
 	// The partition of expression that the object is 
 	// currently working on
 	vector<Block> blocks;
 	
-	// Vector of variables, constants and functions
-	// that might be used in calculations
-	vector<Variable> variables;
-	vector<Variable> constants;
-	vector<Function> functions;
+	// Variables, constants and functions that might be used in
+	// calculations; constants and functions are the same for every
+	// session, so all sessions share one copy
+	Environment variables;
+	shared_ptr<const vector<Variable> > constants;
+	shared_ptr<const vector<Function> > functions;
+	
+	// Result of the last calculation, used as constant "ans"
+	Value ans;
+	
+	// Variable of an expression being compiled; it needs
+	// no value, so lexing accepts it without looking it up
+	string boundVariable;
+	
+	// Results of the special forms of the current evaluation; the
+	// expression refers to result i by the name "_i", which no
+	// variable can have
+	vector<Value> specialResults;
+	
+	// Variables of a loaded snapshot, read from the mapped file
+	// Variables declared afterwards shadow these
+	shared_ptr<SessionSnapshot> baseSession;
+	
+	// Resource limits and the budget of the current evaluation
+	EvalLimits limits;
+	EvalBudget budget;
+	
+	// Reset the budget for a new evaluation
+	void startBudget(bool timed);
+	
+	// Record that a limit was exceeded; returns false
+	bool exceedLimit(LimitError error);
+	
+	// Check whether the time limit of the evaluation has passed
+	bool outOfTime(void);
+	
+	// Charge the operation that gave result to the budget, one
+	// per element of an array; returns false once a limit is exceeded
+	bool charge(const Value &result);
+	
+	// Charge count operations to the budget
+	bool chargeOperations(long long count);
+	
+	// Apply a binary operator within the budget
+	Value applyOperator(char op, const Value &op1, const Value &op2);
+	
+	// Store a calculated result as a variable or as "ans"
+	// and create the output string
+	string recordResult(Value result, bool isDeclaration, string newVarName);
 	
 	// Add predefined constants and functions
 	void addPredefined(void);
@@ -85,14 +223,46 @@ private:
 	// Analyze whether a string Block is of BlockType Func, Constant or Var
 	BlockType analyzeStrType(string str);
 	
+	// Look up a constant (including "ans") by name
+	bool findConstant(const string &name, Value &val);
+	
+	// Look up a user-defined variable by name
+	bool findVariable(const string &name, Value &val);
+	
 	// Determine the type of one single character
-	BlockType charType(char c);
+	static BlockType charType(char c);
+	
+	// Replace every "-" as negative sign by "0-"; returns
+	// false if the time limit passes meanwhile
+	bool dealWithNegativeSign(string &exp);
+	
+	// Replace special forms such as solve(expr, var, lo, hi) and
+	// sum(var, lo, hi, expr) in an expression without spaces by their results
+	bool expandSpecialForms(string &exp);
+	
+	// Calculate the special form name with arguments args
+	Value calculateSpecialForm(const string &name, const vector<string> &args);
+	
+	// Check that var can be bound by a special form
+	bool checkBoundVariable(const string &var);
+	
+	// Special forms: root finding, and sums ('+') and products ('*')
+	Value calculateSolve(const vector<string> &args);
+	Value calculateReduction(char op, const vector<string> &args, bool exact);
+	
+	// Calculate an expression without spaces that is part of a larger
+	// one, keeping the blocks of the caller
+	Value calculateText(string exp);
+	
+	// Compile an expression without spaces into a program of variable var
+	bool compileExp(string exp, const string &var, ExpProgram &program);
 	
-	// Replace every "-" as negative sign by "0-"
-	void dealWithNegativeSign(string &exp);
-
 	// Calculate expression in block range [startBlock,endBlock)
-	Value calculateExp(string exp, int startBlock, int endBlock);
+	Value calculateExp(const string &exp, int startBlock, int endBlock);
+	
+	// Calculate a large block range by evaluating its top-level
+	// operands in parallel; returns false if the range can't be split
+	bool calculateParallel(const string &exp, int startBlock, int endBlock, Value &result);
 	
 	// Given the block id of ')', find the block id of corresponding '('
 	int findIndexOfBracketEnding(int blockId);
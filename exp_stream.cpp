@@ -0,0 +1,492 @@
+/*
+
+exp_stream.cpp
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Implementation of ExpStream class.
+The grammar follows ExpSolver::solveExp: spaces
+are ignored, a '-' at the start of the expression
+or right after '(' '[' or ',' is a negative sign,
+and '^' '*' '/' '+' '-' are calculated from the left
+with the usual priorities.
+
+*/
+
+#include <ctype.h>
+#include <sstream>
+#include "exp_stream.h"
+
+using namespace std;
+
+// Longest token kept; digits of a number past this are too
+// small to change its value, and longer names are refused
+static const size_t MAX_TOKEN_LENGTH = 1024;
+
+// ******************** //
+// * Public Functions * //
+// ******************** //
+
+// Constructor
+ExpStream::ExpStream(ExpSolver &slv) : solver(slv) {
+	reset();
+}
+
+// Feed the next chunk of the expression
+void ExpStream::feed(const char *chunk, size_t length) {
+	for(size_t i = 0; i < length; i++) {
+		if(!isspace(chunk[i])) readChar(chunk[i]);
+	}
+}
+
+void ExpStream::feed(const string &chunk) {
+	feed(chunk.data(), chunk.length());
+}
+
+// End of the expression: finish the calculation and return
+// the output, like solveExp
+string ExpStream::finish() {
+	if(tokenType != NoToken) endToken('\0');
+	
+	// A special form that never closed
+	if(inSpecialForm) bracketsPaired = false;
+	
+	// Report the error solveExp would report first
+	string error;
+	if(equalSigns > 1) error = "Syntax error: Too many '='! ";
+	else if(nameInvalid) error = "Variable name invalid! ";
+	else if(rhsEmpty) error = "Invalid expression! ";
+	else if(!groupError.empty()) error = groupError;
+	else if(bracketLevel != 0 || !bracketsPaired) error = "Syntax error: Brackets not paired! ";
+	else if(failed) error = calcError;
+	else if(expectOperand) error = "Invalid expression! ";
+	
+	// Final calculation of the operators left
+	if(!failed && error.empty()) {
+		while(!ops.empty() && !failed) reduce();
+		error = calcError;
+	}
+	
+	string output;
+	if(failed || !error.empty()) {
+		errorStream() << error;
+		output = "Calculation aborted. ";
+	}
+	else {
+		output = solver.recordResult(values.back(), isDeclaration, newVarName);
+	}
+	
+	reset();
+	return output;
+}
+
+// ********************* //
+// * Private Functions * //
+// ********************* //
+
+// Reset to the state before the first chunk
+void ExpStream::reset() {
+	token.clear();
+	tokenType = NoToken;
+	tokenCut = false;
+	values.clear();
+	ops.clear();
+	expectOperand = true;
+	negativeAllowed = true;
+	firstToken = true;
+	rhsEmpty = true;
+	pendingFunc = -1;
+	bracketLevel = 0;
+	openBrackets.clear();
+	bracketsPaired = true;
+	inSpecialForm = false;
+	specialText.clear();
+	specialLevel = 0;
+	equalSigns = 0;
+	isDeclaration = false;
+	nameInvalid = false;
+	newVarName = "";
+	groupError = "";
+	calcError = "";
+	failed = false;
+	
+	// Chunks may be slow to arrive, so only operations are budgeted
+	solver.startBudget(false);
+}
+
+// Handle one non-space character
+void ExpStream::readChar(char c) {
+	if(inSpecialForm) {
+		readSpecialChar(c);
+		return;
+	}
+	
+	// Extend the current token if c belongs to it
+	if(tokenType == NumToken && (isdigit(c) || c == '.')) {
+		extendNumber(c);
+		return;
+	}
+	if(tokenType == NameToken && (isalnum(c) || c == '_' || c == '.')) {
+		extendName(c);
+		return;
+	}
+	if(tokenType != NoToken) endToken(c);
+	if(inSpecialForm) {
+		readSpecialChar(c);
+		return;
+	}
+	
+	if(c == '=') {
+		readEqualSign();
+		return;
+	}
+	rhsEmpty = false;
+	
+	if(isdigit(c) || c == '.') {
+		token = c;
+		tokenType = NumToken;
+	}
+	else if(isalpha(c) || c == '_') {
+		token = c;
+		tokenType = NameToken;
+	}
+	else if(c == '(' || c == '[') readBracketLeft(c);
+	else if(c == ')' || c == ']') readBracketRight(c);
+	else if(c == ',') readComma();
+	else if(c == '+' || c == '-' || c == '*' || c == '/' || c == '^') readOperator(c);
+	else fail("Encountered unknown character! ");
+	
+	// A token at the start may still turn out to be a variable name
+	if(tokenType == NoToken) firstToken = false;
+}
+
+// Add a character to the number being read
+void ExpStream::extendNumber(char c) {
+	// Value(string) takes at most 11 characters without a point,
+	// and fewer before one, so 12 are already too large
+	if(token.length() >= 12 && token.find('.') == string::npos) return;
+	
+	// Digits this far after the point can't change the decimal value
+	if(token.length() >= MAX_TOKEN_LENGTH) {
+		tokenCut = tokenCut || (c != '0' && c != '.');
+		return;
+	}
+	token += c;
+}
+
+// Add a character to the name being read
+void ExpStream::extendName(char c) {
+	if(token.length() >= MAX_TOKEN_LENGTH) {
+		tokenCut = true;
+		return;
+	}
+	token += c;
+}
+
+// Handle a completed token; next is the character after it
+void ExpStream::endToken(char next) {
+	string str;
+	str.swap(token);
+	TokenType type = tokenType;
+	tokenType = NoToken;
+	bool first = firstToken;
+	firstToken = false;
+	bool cut = tokenCut;
+	tokenCut = false;
+	
+	if(type == NumToken) {
+		// A digit was left out: keep one, so that the number
+		// is still a decimal rather than an exact fraction
+		if(cut) str += '1';
+		if(!failed) pushValue(Value(str));
+		return;
+	}
+	
+	// Names too long to keep are refused
+	if(cut) {
+		solver.exceedLimit(InputTooLong);
+		fail(ExpSolver::limitMessage(InputTooLong));
+	}
+	
+	// A name followed by the first '=' is a variable declaration
+	if(first && next == '=') {
+		nameInvalid = !isalpha(str[0]);
+		for(int i = 1; i < (int)str.length(); i++) {
+			nameInvalid |= !(isalnum(str[i]) || str[i] == '_');
+		}
+		isDeclaration = true;
+		newVarName = str;
+		return;
+	}
+	if(cut) return;
+	
+	// Special forms need their whole text, which is read on until
+	// their brackets close
+	if(next == '(' && (str.compare("solve") == 0 || str.compare("sum") == 0
+		|| str.compare("prod") == 0)) {
+		inSpecialForm = true;
+		if(!failed) specialText = str;
+		return;
+	}
+	
+	// Only the first unknown name is reported, so stop
+	// looking names up once there is one
+	if(!groupError.empty()) return;
+	ostringstream lookupErrors;
+	ostream *callerStream = &errorStream();
+	setErrorStream(&lookupErrors);
+	BlockType strType = solver.analyzeStrType(str);
+	setErrorStream(callerStream);
+	if(strType == Nil) {
+		groupError = lookupErrors.str();
+		failed = true;
+		return;
+	}
+	if(failed) return;
+	
+	if(strType == Func) {
+		if(next != '(') {
+			fail("Syntax Error: Need brackets after function name! ");
+			return;
+		}
+		for(int i = 0; i < (int)solver.functions->size(); i++) {
+			if(str.compare((*solver.functions)[i].name) == 0) pendingFunc = i;
+		}
+	}
+	else if(strType == Constant) {
+		Value constValue;
+		solver.findConstant(str, constValue);
+		
+		// If constant doesn't have a value
+		// that means that 'ans' is not defined
+		if(!constValue.getCalculability()) {
+			fail("Bad access: \"ans\" not defined currently! ");
+			return;
+		}
+		pushValue(constValue);
+	}
+	else {
+		Value varValue;
+		solver.findVariable(str, varValue);
+		pushValue(varValue);
+	}
+}
+
+// Add a character to the special form being read
+void ExpStream::readSpecialChar(char c) {
+	if(c == '(' || c == '[') specialLevel++;
+	else if(c == ')' || c == ']') specialLevel--;
+	
+	// After an error the text is only skipped
+	if(!failed) {
+		size_t maxLength = solver.limits.maxInputLength;
+		if(maxLength && specialText.length() >= maxLength) {
+			solver.exceedLimit(InputTooLong);
+			fail(ExpSolver::limitMessage(InputTooLong));
+			specialText.clear();
+		}
+		else specialText += c;
+	}
+	if(specialLevel > 0) return;
+	
+	inSpecialForm = false;
+	string text;
+	text.swap(specialText);
+	if(failed) return;
+	if(!expectOperand) {
+		fail("Invalid expression! ");
+		return;
+	}
+	
+	// Its error is reported at the end, like other calculation errors
+	ostringstream specialErrors;
+	ostream *callerStream = &errorStream();
+	setErrorStream(&specialErrors);
+	Value result = solver.calculateText(text);
+	setErrorStream(callerStream);
+	if(solver.getLimitError() != NoLimitError) {
+		fail(ExpSolver::limitMessage(solver.getLimitError()));
+		return;
+	}
+	if(!result.getCalculability()) {
+		fail(specialErrors.str());
+		return;
+	}
+	pushValue(result);
+}
+
+void ExpStream::readEqualSign() {
+	equalSigns++;
+	if(equalSigns > 1) return;
+	
+	// Everything after the first '=' is the expression
+	if(!isDeclaration) nameInvalid = true;
+	rhsEmpty = true;
+}
+
+void ExpStream::readOperator(char op) {
+	if(failed) return;
+	if(expectOperand) {
+		// Read a negative sign as "0-"
+		if(op == '-' && negativeAllowed) {
+			pushValue(Value(Fraction(0, 1)));
+		}
+		else {
+			fail("Invalid expression! ");
+			return;
+		}
+	}
+	
+	// Calculate the operators on the stack that come first
+	while(!ops.empty() && ops.back().op != '(' && ops.back().op != '['
+		&& priority(ops.back().op) >= priority(op)) {
+		reduce();
+	}
+	ops.push_back(StreamOp(op, -1));
+	expectOperand = true;
+	negativeAllowed = false;
+}
+
+void ExpStream::readBracketLeft(char bracket) {
+	bracketLevel++;
+	openBrackets += bracket;
+	if(failed) return;
+	if(solver.limits.maxDepth && bracketLevel > solver.limits.maxDepth) {
+		solver.exceedLimit(TooDeep);
+		fail(ExpSolver::limitMessage(TooDeep));
+		return;
+	}
+	if(!expectOperand) {
+		fail("Invalid expression! ");
+		return;
+	}
+	ops.push_back(StreamOp(bracket, pendingFunc));
+	pendingFunc = -1;
+	negativeAllowed = true;
+}
+
+void ExpStream::readBracketRight(char bracket) {
+	bracketLevel--;
+	if(!openBrackets.empty()) {
+		bracketsPaired &= (openBrackets[openBrackets.length()-1] == '(') == (bracket == ')');
+		openBrackets.erase(openBrackets.length()-1);
+	}
+	if(failed) return;
+	if(bracketLevel < 0 || !bracketsPaired) {
+		fail("Syntax error: Brackets not paired! ");
+		return;
+	}
+	if(expectOperand) {
+		fail("Invalid expression! ");
+		return;
+	}
+	
+	// Calculate the contents of the bracket
+	while(ops.back().op != '(' && ops.back().op != '[') reduce();
+	StreamOp opening = ops.back();
+	ops.pop_back();
+	negativeAllowed = false;
+	
+	// Collect the elements of an array
+	if(bracket == ']') {
+		int count = opening.commas + 1;
+		vector<Value> elements(values.end() - count, values.end());
+		values.resize(values.size() - count);
+		values.push_back(Value(elements));
+		if(!values.back().getCalculability()) {
+			failed = true;
+			return;
+		}
+		if(!solver.charge(values.back())) {
+			fail(ExpSolver::limitMessage(solver.getLimitError()));
+		}
+		return;
+	}
+	int func = opening.func;
+	if(func < 0) return;
+	
+	// Apply the function before the bracket (to every element of an array)
+	Value valueInFunc = values.back();
+	if(!valueInFunc.getCalculability()) {
+		failed = true;
+		return;
+	}
+	
+	// Its error is reported at the end, like other calculation errors
+	ostringstream functionErrors;
+	ostream *callerStream = &errorStream();
+	setErrorStream(&functionErrors);
+	values.back() = valueInFunc.applyFunction((*solver.functions)[func].func);
+	setErrorStream(callerStream);
+	if(!values.back().getCalculability()) {
+		fail(functionErrors.str());
+		return;
+	}
+	if(!solver.charge(values.back())) {
+		fail(ExpSolver::limitMessage(solver.getLimitError()));
+	}
+}
+
+// A comma ends an element of an array
+void ExpStream::readComma() {
+	if(failed) return;
+	if(expectOperand) {
+		fail("Invalid expression! ");
+		return;
+	}
+	while(!ops.empty() && ops.back().op != '(' && ops.back().op != '[') reduce();
+	if(ops.empty() || ops.back().op != '[') {
+		fail("Encountered unknown character! ");
+		return;
+	}
+	ops.back().commas++;
+	expectOperand = true;
+	negativeAllowed = true;
+}
+
+// Push an operand, checking that one is expected
+void ExpStream::pushValue(Value val) {
+	if(!expectOperand) {
+		fail("Invalid expression! ");
+		return;
+	}
+	values.push_back(val);
+	expectOperand = false;
+	negativeAllowed = false;
+}
+
+// Apply the operator on top of the operator stack
+void ExpStream::reduce() {
+	char op = ops.back().op;
+	ops.pop_back();
+	Value op2 = values.back(); values.pop_back();
+	Value op1 = values.back(); values.pop_back();
+	
+	// Its error is reported at the end, like other calculation errors
+	ostringstream operatorErrors;
+	ostream *callerStream = &errorStream();
+	setErrorStream(&operatorErrors);
+	values.push_back(solver.applyOperator(op, op1, op2));
+	setErrorStream(callerStream);
+	if(solver.getLimitError() != NoLimitError) {
+		fail(ExpSolver::limitMessage(solver.getLimitError()));
+	}
+	else if(!values.back().getCalculability()) {
+		fail(operatorErrors.str());
+	}
+}
+
+// Record an error and stop calculating; the rest of the
+// expression is still checked for earlier kinds of errors
+void ExpStream::fail(string message) {
+	if(!failed) calcError = message;
+	failed = true;
+}
+
+// Calculation priority of an operator
+int ExpStream::priority(char op) {
+	if(op == '^') return 3;
+	if(op == '*' || op == '/') return 2;
+	return 1;
+}
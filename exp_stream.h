@@ -0,0 +1,140 @@
+/*
+
+exp_stream.h
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Header file for ExpStream class that
+solves an expression delivered in chunks. Tokens
+are read and operators reduced as the chunks come
+in (shunting-yard), so only the operand and operator
+stacks are kept: memory grows with the bracket depth
+of the expression, not with its length.
+
+*/
+
+#include <string>
+#include <vector>
+#include "exp_solver.h"
+
+using namespace std;
+
+#ifndef EXP_STREAM_H
+#define EXP_STREAM_H
+
+// Entry of the operator stack; '(' entries remember
+// the function applied when the bracket closes (-1 for none),
+// and '[' entries count the commas of the array so far
+struct StreamOp {
+	char op;
+	int func;
+	int commas;
+	StreamOp(char o, int f) : op(o), func(f), commas(0) {}
+};
+
+class ExpStream {
+public:
+	
+	// Constructor; the expression is solved with the
+	// variables, constants and functions of solver
+	ExpStream(ExpSolver &solver);
+	
+	// Feed the next chunk of the expression
+	void feed(const char *chunk, size_t length);
+	void feed(const string &chunk);
+	
+	// End of the expression: finish the calculation and return
+	// the output, like solveExp; the stream can then be reused
+	string finish(void);
+
+private:
+	
+	enum TokenType { NoToken, NumToken, NameToken };
+	
+	ExpSolver &solver;
+	
+	// Incomplete token; it may continue in the next chunk
+	string token;
+	TokenType tokenType;
+	
+	// Characters were left out of the token because it grew too long;
+	// for a number, a digit other than '0' was left out
+	bool tokenCut;
+	
+	// Operand and operator stacks
+	vector<Value> values;
+	vector<StreamOp> ops;
+	
+	// Parser state
+	bool expectOperand;
+	bool negativeAllowed;
+	bool firstToken;
+	bool rhsEmpty;
+	int pendingFunc;
+	int bracketLevel;
+	
+	// Brackets that are open, to check that '(' is closed by ')'
+	// and '[' by ']'
+	string openBrackets;
+	bool bracketsPaired;
+	
+	// Text of a special form such as sum(...) being read; it is
+	// kept whole and solved like solveExp does once its brackets close
+	bool inSpecialForm;
+	string specialText;
+	int specialLevel;
+	
+	// Declaration state
+	int equalSigns;
+	bool isDeclaration;
+	bool nameInvalid;
+	string newVarName;
+	
+	// The first error of each kind; like solveExp, errors in the
+	// declaration come before unknown names and unpaired brackets,
+	// which come before errors found during calculation
+	string groupError;
+	string calcError;
+	bool failed;
+	
+	// Reset to the state before the first chunk
+	void reset(void);
+	
+	// Handle one non-space character
+	void readChar(char c);
+	
+	// Add a character to the number or name being read, leaving
+	// out those past the length that can still matter
+	void extendNumber(char c);
+	void extendName(char c);
+	
+	// Handle a completed token; next is the character after it
+	// ('\0' at the end of the expression)
+	void endToken(char next);
+	
+	// Add a character to the special form being read
+	void readSpecialChar(char c);
+	
+	// Handle the operator characters
+	void readEqualSign(void);
+	void readOperator(char op);
+	void readBracketLeft(char bracket);
+	void readBracketRight(char bracket);
+	void readComma(void);
+	
+	// Push an operand, checking that one is expected
+	void pushValue(Value val);
+	
+	// Apply the operator on top of the operator stack
+	void reduce(void);
+	
+	// Record an error and stop calculating; the rest of the
+	// expression is still checked for earlier kinds of errors
+	void fail(string message);
+	
+	// Calculation priority of an operator
+	static int priority(char op);
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+
+load_client.cpp
+
+Author: Jingyun Yang
+Date Created: 10/18/26
+
+Description: Load generator for the server mode
+of expression solver. Opens several connections,
+keeps a number of pipelined requests in flight on
+each and reports throughput and tail latency.
+
+Usage: load_client <socket path | port> [connections]
+	[requests per connection] [pipeline depth] [expression]
+
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct ClientResult {
+	vector<double> latencies;
+	long errors;
+	bool failed;
+	ClientResult() : errors(0), failed(false) {}
+};
+
+// Connect to a Unix socket path or localhost TCP port
+int connectTo(string address) {
+	bool isPort = address.find_first_not_of("0123456789") == string::npos;
+	int fd;
+	if(isPort) {
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(atoi(address.c_str()));
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	else {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	return fd;
+}
+
+bool writeAll(int fd, const string &data) {
+	size_t written = 0;
+	while(written < data.length()) {
+		ssize_t n = write(fd, data.data() + written, data.length() - written);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			return false;
+		}
+		written += n;
+	}
+	return true;
+}
+
+// Send requestCount requests on one connection, keeping up to
+// depth of them in flight, and record the latency of each
+void runClient(string address, long requestCount, int depth,
+		string expression, ClientResult &result) {
+	int fd = connectTo(address);
+	if(fd < 0) {
+		result.failed = true;
+		return;
+	}
+	
+	deque<Clock::time_point> inFlight;
+	string inBuf;
+	char buf[65536];
+	long sent = 0, received = 0;
+	
+	while(received < requestCount) {
+		// Top up the pipeline
+		string batch;
+		while((long)inFlight.size() < depth && sent < requestCount) {
+			batch += expression + "\n";
+			inFlight.push_back(Clock::now());
+			sent++;
+		}
+		if(!batch.empty() && !writeAll(fd, batch)) {
+			result.failed = true;
+			break;
+		}
+		
+		// Collect whatever replies have arrived
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if(n <= 0) {
+			if(n < 0 && errno == EINTR) continue;
+			result.failed = true;
+			break;
+		}
+		inBuf.append(buf, n);
+		size_t lineStart = 0, found;
+		Clock::time_point now = Clock::now();
+		while((found = inBuf.find('\n', lineStart)) != string::npos) {
+			if(inBuf.find("aborted", lineStart) < found) {
+				result.errors++;
+			}
+			chrono::duration<double, micro> latency = now - inFlight.front();
+			result.latencies.push_back(latency.count());
+			inFlight.pop_front();
+			received++;
+			lineStart = found + 1;
+		}
+		inBuf.erase(0, lineStart);
+	}
+	
+	writeAll(fd, "quit\n");
+	close(fd);
+}
+
+// Latency at quantile q of sorted latencies
+double percentile(const vector<double> &sorted, double q) {
+	if(sorted.empty()) return 0;
+	size_t index = (size_t)(q * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+int main(int argc, char *argv[]) {
+	if(argc < 2) {
+		cerr << "Usage: load_client <socket path | port> [connections]"
+			<< " [requests per connection] [pipeline depth] [expression]" << endl;
+		return 1;
+	}
+	string address = argv[1];
+	int connectionCount = argc >= 3 ? atoi(argv[2]) : 8;
+	long requestCount = argc >= 4 ? atol(argv[3]) : 10000;
+	int depth = argc >= 5 ? atoi(argv[4]) : 32;
+	string expression = argc >= 6 ? argv[5] : "1+((2-3*4)/5)^6";
+	if(connectionCount < 1 || requestCount < 1 || depth < 1) {
+		cerr << "Connections, requests and depth must be positive!" << endl;
+		return 1;
+	}
+	
+	vector<ClientResult> results(connectionCount);
+	vector<thread> clients;
+	Clock::time_point start = Clock::now();
+	for(int i = 0; i < connectionCount; i++) {
+		clients.push_back(thread(runClient, address, requestCount, depth,
+			expression, ref(results[i])));
+	}
+	for(int i = 0; i < connectionCount; i++) clients[i].join();
+	chrono::duration<double> elapsed = Clock::now() - start;
+	
+	// Merge the results of all connections
+	vector<double> latencies;
+	long errors = 0, failedConnections = 0;
+	for(int i = 0; i < connectionCount; i++) {
+		latencies.insert(latencies.end(), results[i].latencies.begin(),
+			results[i].latencies.end());
+		errors += results[i].errors;
+		failedConnections += results[i].failed;
+	}
+	sort(latencies.begin(), latencies.end());
+	
+	cout << fixed << setprecision(1);
+	cout << "Connections:     " << connectionCount
+		<< " (" << failedConnections << " failed)" << endl;
+	cout << "Pipeline depth:  " << depth << endl;
+	cout << "Requests:        " << latencies.size()
+		<< " (" << errors << " aborted)" << endl;
+	cout << "Elapsed:         " << elapsed.count() << " s" << endl;
+	cout << "Throughput:      " << latencies.size() / elapsed.count() << " req/s" << endl;
+	cout << "Latency p50:     " << percentile(latencies, 0.50) << " us" << endl;
+	cout << "Latency p99:     " << percentile(latencies, 0.99) << " us" << endl;
+	cout << "Latency p99.9:   " << percentile(latencies, 0.999) << " us" << endl;
+	cout << "Latency max:     " << (latencies.empty() ? 0 : latencies.back()) << " us" << endl;
+	return failedConnections == 0 ? 0 : 1;
+}
@@ -11,13 +11,76 @@ exp_solver.h to solve algebraic expressions.
 */
 
 #include <iostream>
+#include <string>
+#include <stdlib.h>
+#include <thread>
 #include "exp_solver.h"
+#include "server.h"
+#include "exp_stream.h"
 
 using namespace std;
 
-int main() {
+// Solve expressions piped to stdin, one per line, reading them in
+// chunks so that no line is ever held in memory as a whole
+int runStream() {
+	ExpSolver mySolver = ExpSolver();
+	ExpStream stream(mySolver);
+	
+	char chunk[65536];
+	bool lineStarted = false;
+	size_t length;
+	while((length = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+		size_t start = 0;
+		for(size_t i = 0; i < length; i++) {
+			if(chunk[i] != '\n') continue;
+			stream.feed(chunk + start, i - start);
+			if(lineStarted || i > start) {
+				cout << stream.finish() << endl;
+			}
+			lineStarted = false;
+			start = i + 1;
+		}
+		stream.feed(chunk + start, length - start);
+		lineStarted |= (length > start);
+	}
+	if(lineStarted) cout << stream.finish() << endl;
+	return 0;
+}
+
+// Serve clients on a Unix socket path or localhost TCP port
+int runServer(string address, int workerCount, string sessionFile) {
+	ExpServer server(workerCount);
+	if(sessionFile.length() > 0 && !server.loadInitialSession(sessionFile)) {
+		cerr << endl;
+		return 1;
+	}
+	bool isPort = address.find_first_not_of("0123456789") == string::npos;
+	bool listening = isPort ? server.listenTcp(atoi(address.c_str()))
+		: server.listenUnix(address);
+	if(!listening) {
+		cerr << endl;
+		return 1;
+	}
+	cout << "| Serving on " << address << " with " << workerCount << " workers" << endl;
+	server.run();
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	// Usage: expsolver --server <socket path | port> [workers] [session file]
+	if(argc >= 3 && string(argv[1]) == "--server") {
+		int workerCount = argc >= 4 ? atoi(argv[3]) : thread::hardware_concurrency();
+		return runServer(argv[2], workerCount, argc >= 5 ? argv[4] : "");
+	}
+	
+	// Usage: expsolver --stream < expressions
+	if(argc >= 2 && string(argv[1]) == "--stream") {
+		return runStream();
+	}
+	
 	cout << "| Welcome to expression solver developed by Jingyun Yang!" << endl;
 	cout << "| To use this program, type in expressions or declarations for it to solve." << endl;
+	cout << "| To save or restore the session, enter \"save <file>\" or \"load <file>\"." << endl;
 	cout << "| To quit, enter \"quit\" and press [Enter]." << endl;
 	cout << "| Enjoy!" << endl << endl;
 	
@@ -33,6 +96,22 @@ int main() {
 		
 		cout << "| ";
 		
+		// Session snapshot commands
+		if(input.compare(0, 5, "save ") == 0) {
+			if(mySolver.saveSession(input.substr(5))) {
+				cout << "Session saved to " << input.substr(5);
+			}
+			cout << endl << endl;
+			continue;
+		}
+		if(input.compare(0, 5, "load ") == 0) {
+			if(mySolver.loadSession(input.substr(5))) {
+				cout << "Session loaded from " << input.substr(5);
+			}
+			cout << endl << endl;
+			continue;
+		}
+		
 		string output = mySolver.solveExp(input);
 		cout << output << endl << endl;
 	}
@@ -0,0 +1,481 @@
+/*
+
+server.cpp
+
+Author: Jingyun Yang
+Date Created: 10/18/26
+
+Description: Implementation of ExpServer. One
+event loop thread (epoll) accepts clients, reads
+requests and writes replies; a pool of workers
+solves the requests.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "server.h"
+
+using namespace std;
+
+// epoll tags for the two non-client descriptors;
+// connection ids start after them
+static const uint64_t LISTEN_TAG = 0;
+static const uint64_t WAKE_TAG = 1;
+
+// Stop reading from a connection while this many requests wait
+static const size_t MAX_PENDING = 65536;
+
+// Stop reading from a connection while its waiting requests and
+// incomplete line hold this many bytes; a single line may still
+// grow up to the session's input limit while nothing else waits
+static const size_t MAX_PENDING_BYTES = 1 << 20;
+
+// Stop reading from and solving for a connection while
+// this many bytes of replies wait to be written
+static const size_t MAX_OUTPUT = 1 << 20;
+
+// Requests a worker takes from a connection at a time
+static const int SOLVE_BATCH = 64;
+
+// Request that stands for a line too long for the session; a real
+// request can't hold '\n'
+static const string TOO_LONG_LINE = "\n";
+
+// ******************** //
+// * WorkerPool       * //
+// ******************** //
+
+WorkerPool::WorkerPool(int threadCount) : stopping(false) {
+	if(threadCount < 1) threadCount = 1;
+	for(int i = 0; i < threadCount; i++) {
+		workers.push_back(thread(&WorkerPool::workerLoop, this));
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	join();
+}
+
+// Queue a task to be run on one of the workers
+void WorkerPool::submit(function<void()> task) {
+	{
+		lock_guard<mutex> guard(tasksLock);
+		tasks.push(task);
+	}
+	tasksReady.notify_one();
+}
+
+// Finish queued tasks and stop the workers
+void WorkerPool::join() {
+	{
+		lock_guard<mutex> guard(tasksLock);
+		stopping = true;
+	}
+	tasksReady.notify_all();
+	for(int i = 0; i < (int)workers.size(); i++) {
+		if(workers[i].joinable()) workers[i].join();
+	}
+}
+
+void WorkerPool::workerLoop() {
+	while(1) {
+		function<void()> task;
+		{
+			unique_lock<mutex> guard(tasksLock);
+			while(!stopping && tasks.empty()) tasksReady.wait(guard);
+			if(tasks.empty()) return;
+			task = tasks.front();
+			tasks.pop();
+		}
+		task();
+	}
+}
+
+// ******************** //
+// * Public Functions * //
+// ******************** //
+
+// Constructor
+ExpServer::ExpServer(int workerCount)
+	: listenFd(-1), stopping(false), nextConnectionId(WAKE_TAG + 1),
+	pool(workerCount) {
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = WAKE_TAG;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+}
+
+ExpServer::~ExpServer() {
+	// Workers may still write to wakeFd, so stop them first
+	pool.join();
+	while(!connections.empty()) {
+		closeConnection(connections.begin()->second);
+	}
+	if(listenFd >= 0) close(listenFd);
+	close(wakeFd);
+	close(epollFd);
+}
+
+// Listen on a Unix domain socket at path
+bool ExpServer::listenUnix(string path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path.length() >= sizeof(addr.sun_path)) {
+		cerr << "Socket path too long! ";
+		return false;
+	}
+	strcpy(addr.sun_path, path.c_str());
+	unlink(path.c_str());
+	
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(listenFd < 0 || bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+		|| listen(listenFd, SOMAXCONN) != 0) {
+		cerr << "Cannot listen on \"" << path << "\": " << strerror(errno) << " ";
+		return false;
+	}
+	
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = LISTEN_TAG;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+	return true;
+}
+
+// Listen on localhost TCP port
+bool ExpServer::listenTcp(int port) {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	
+	listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int reuse = 1;
+	if(listenFd >= 0) {
+		setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	}
+	if(listenFd < 0 || bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+		|| listen(listenFd, SOMAXCONN) != 0) {
+		cerr << "Cannot listen on port " << port << ": " << strerror(errno) << " ";
+		return false;
+	}
+	
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = LISTEN_TAG;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+	return true;
+}
+
+// Start every new connection with the variables and ans of a snapshot
+bool ExpServer::loadInitialSession(string fileName) {
+	return initialSession.loadSession(fileName);
+}
+
+// Run the event loop until stop() is called
+void ExpServer::run() {
+	struct epoll_event events[256];
+	while(!stopping) {
+		int count = epoll_wait(epollFd, events, 256, -1);
+		if(count < 0) {
+			if(errno == EINTR) continue;
+			cerr << "epoll_wait failed: " << strerror(errno) << endl;
+			return;
+		}
+		for(int i = 0; i < count; i++) {
+			uint64_t tag = events[i].data.u64;
+			if(tag == LISTEN_TAG) {
+				acceptClients();
+				continue;
+			}
+			if(tag == WAKE_TAG) {
+				flushFromWorkers();
+				continue;
+			}
+			map<uint64_t, shared_ptr<Connection> >::iterator it = connections.find(tag);
+			if(it == connections.end()) continue;
+			shared_ptr<Connection> conn = it->second;
+			if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				readRequests(conn);
+			}
+			if(connections.count(tag) && (events[i].events & EPOLLOUT)) {
+				writeReplies(conn);
+			}
+		}
+	}
+}
+
+// Make run() return; safe to call from any thread
+void ExpServer::stop() {
+	stopping = true;
+	uint64_t one = 1;
+	if(write(wakeFd, &one, sizeof(one)) < 0) {}
+}
+
+// ********************* //
+// * Private Functions * //
+// ********************* //
+
+void ExpServer::acceptClients() {
+	while(1) {
+		int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0) return;
+		
+		shared_ptr<Connection> conn(new Connection(fd, nextConnectionId++, initialSession));
+		connections[conn->id] = conn;
+		updateEvents(conn);
+	}
+}
+
+void ExpServer::readRequests(shared_ptr<Connection> conn) {
+	char buf[65536];
+	vector<string> lines;
+	size_t lineBytes = 0;
+	bool failed = false;
+	
+	while(!conn->readClosed) {
+		ssize_t n = read(conn->fd, buf, sizeof(buf));
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			failed = (errno != EAGAIN && errno != EWOULDBLOCK);
+			break;
+		}
+		if(n == 0) {
+			conn->readClosed = true;
+			break;
+		}
+		
+		// Split complete lines off the input buffer; only the bytes
+		// just read can hold a '\n'
+		conn->inBuf.append(buf, n);
+		size_t lineStart = 0, found, from = conn->scanned;
+		while((found = conn->inBuf.find('\n', from)) != string::npos) {
+			string line = conn->inBuf.substr(lineStart, found - lineStart);
+			if(line.length() > 0 && line[line.length()-1] == '\r') {
+				line.erase(line.length()-1);
+			}
+			lineStart = from = found + 1;
+			
+			// The start of this line was too long and is already answered
+			if(conn->skippingLine) {
+				conn->skippingLine = false;
+				continue;
+			}
+			if(line == "quit") {
+				conn->readClosed = true;
+				break;
+			}
+			lines.push_back(line);
+			lineBytes += line.length() + 1;
+		}
+		conn->inBuf.erase(0, lineStart);
+		conn->scanned = conn->inBuf.length();
+		
+		// A line already longer than the session takes (and a '\r') is
+		// answered now; the rest of it is dropped instead of kept
+		size_t maxLength = conn->session.getLimits().maxInputLength;
+		if(maxLength && !conn->skippingLine && conn->scanned > maxLength + 1) {
+			lines.push_back(TOO_LONG_LINE);
+			lineBytes += TOO_LONG_LINE.length() + 1;
+			conn->skippingLine = true;
+		}
+		if(conn->skippingLine) {
+			conn->inBuf.clear();
+			conn->scanned = 0;
+		}
+		
+		// Leave the rest in the socket buffer while too much is queued
+		lock_guard<mutex> guard(conn->lock);
+		if(conn->pending.size() + lines.size() >= MAX_PENDING
+			|| !readableBytes(*conn, conn->pendingBytes + lineBytes)
+			|| conn->outBuf.length() >= MAX_OUTPUT) break;
+	}
+	
+	if(failed) {
+		closeConnection(conn);
+		return;
+	}
+	
+	{
+		lock_guard<mutex> guard(conn->lock);
+		conn->pending.insert(conn->pending.end(), lines.begin(), lines.end());
+		conn->pendingBytes += lineBytes;
+	}
+	writeReplies(conn);
+}
+
+void ExpServer::writeReplies(shared_ptr<Connection> conn) {
+	bool failed = false, done;
+	{
+		lock_guard<mutex> guard(conn->lock);
+		size_t written = 0;
+		while(written < conn->outBuf.length()) {
+			ssize_t n = send(conn->fd, conn->outBuf.data() + written,
+				conn->outBuf.length() - written, MSG_NOSIGNAL);
+			if(n < 0) {
+				if(errno == EINTR) continue;
+				failed = (errno != EAGAIN && errno != EWOULDBLOCK);
+				break;
+			}
+			written += n;
+		}
+		conn->outBuf.erase(0, written);
+		done = conn->readClosed && !conn->busy
+			&& conn->pending.empty() && conn->outBuf.empty();
+	}
+	
+	if(failed || done) {
+		closeConnection(conn);
+		return;
+	}
+	
+	// Requests held back while the replies were over the cap
+	// (or that were just read) can be solved now
+	schedule(conn);
+	updateEvents(conn);
+}
+
+// Write the replies that workers produced since the last wakeup
+void ExpServer::flushFromWorkers() {
+	uint64_t count;
+	if(read(wakeFd, &count, sizeof(count)) < 0) {}
+	
+	vector<uint64_t> ids;
+	{
+		lock_guard<mutex> guard(flushLock);
+		ids.swap(toFlush);
+	}
+	for(int i = 0; i < (int)ids.size(); i++) {
+		map<uint64_t, shared_ptr<Connection> >::iterator it = connections.find(ids[i]);
+		if(it == connections.end()) continue;
+		writeReplies(it->second);
+	}
+}
+
+// Register the events conn currently needs with epoll
+void ExpServer::updateEvents(shared_ptr<Connection> conn) {
+	uint32_t events = 0;
+	{
+		lock_guard<mutex> guard(conn->lock);
+		if(!conn->readClosed && conn->pending.size() < MAX_PENDING
+			&& readableBytes(*conn, conn->pendingBytes)
+			&& conn->outBuf.length() < MAX_OUTPUT) events |= EPOLLIN;
+		if(!conn->outBuf.empty()) events |= EPOLLOUT;
+	}
+	
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.u64 = conn->id;
+	if(conn->events == 0 && events != 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, conn->fd, &ev);
+	}
+	else if(conn->events != 0 && events == 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, &ev);
+	}
+	else if(conn->events != events) {
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+	}
+	conn->events = events;
+}
+
+// Hand pending requests of conn to a worker if none is on it
+void ExpServer::schedule(shared_ptr<Connection> conn) {
+	{
+		lock_guard<mutex> guard(conn->lock);
+		if(conn->busy || conn->pending.empty() || conn->outBuf.length() >= MAX_OUTPUT) return;
+		conn->busy = true;
+	}
+	pool.submit([this, conn]() { solvePending(conn); });
+}
+
+// Solve pending requests of conn; runs on a worker
+void ExpServer::solvePending(shared_ptr<Connection> conn) {
+	bool more = true;
+	while(more) {
+		vector<string> requests;
+		{
+			lock_guard<mutex> guard(conn->lock);
+			for(int i = 0; i < SOLVE_BATCH && !conn->pending.empty(); i++) {
+				requests.push_back(conn->pending.front());
+				conn->pending.pop_front();
+			}
+		}
+		
+		string replies;
+		size_t solvedBytes = 0;
+		for(int i = 0; i < (int)requests.size(); i++) {
+			replies += solveRequest(conn->session, requests[i]) + "\n";
+			solvedBytes += requests[i].length() + 1;
+		}
+		
+		{
+			lock_guard<mutex> guard(conn->lock);
+			conn->outBuf += replies;
+			conn->pendingBytes -= solvedBytes;
+			
+			// Stop once the replies are over the cap; writeReplies
+			// schedules the rest when the client has read them
+			if(conn->pending.empty() || conn->outBuf.length() >= MAX_OUTPUT) {
+				conn->busy = false;
+				more = false;
+			}
+		}
+		
+		// Let the event loop write the replies
+		{
+			lock_guard<mutex> guard(flushLock);
+			toFlush.push_back(conn->id);
+		}
+		uint64_t one = 1;
+		if(write(wakeFd, &one, sizeof(one)) < 0) {}
+	}
+}
+
+void ExpServer::closeConnection(shared_ptr<Connection> conn) {
+	if(conn->events != 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+		conn->events = 0;
+	}
+	close(conn->fd);
+	connections.erase(conn->id);
+}
+
+// Whether more can be read from conn while pendingBytes bytes of
+// requests wait; called with conn.lock held
+bool ExpServer::readableBytes(const Connection &conn, size_t pendingBytes) {
+	// With nothing waiting, only the session's input limit caps the line
+	if(pendingBytes == 0) return true;
+	return pendingBytes + conn.inBuf.length() < MAX_PENDING_BYTES;
+}
+
+// Solve one request line and build its reply line
+string ExpServer::solveRequest(ExpSolver &session, const string &request) {
+	if(request == TOO_LONG_LINE) {
+		return ExpSolver::limitMessage(InputTooLong) + "Calculation aborted. ";
+	}
+	
+	// Collect the error messages of this request only
+	ostringstream errors;
+	setErrorStream(&errors);
+	string output = session.solveExp(request);
+	setErrorStream(NULL);
+	return errors.str() + output;
+}
@@ -0,0 +1,172 @@
+/*
+
+server.h
+
+Author: Jingyun Yang
+Date Created: 10/18/26
+
+Description: Header file for ExpServer class that
+serves many clients from one process. Each client
+connection owns its own ExpSolver session, forked
+in O(1) from a session shared by all connections.
+
+Protocol: clients send one expression per line and
+may pipeline any number of lines without waiting.
+The server answers every line with one line, in
+request order, containing the error messages (if
+any) followed by the output of solveExp. The line
+"quit" closes the connection.
+
+*/
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+#include "exp_solver.h"
+
+using namespace std;
+
+#ifndef SERVER_H
+#define SERVER_H
+
+// Fixed-size pool of threads that run queued tasks
+class WorkerPool {
+public:
+	WorkerPool(int threadCount);
+	~WorkerPool();
+	
+	// Queue a task to be run on one of the workers
+	void submit(function<void()> task);
+	
+	// Finish queued tasks and stop the workers
+	void join(void);
+
+private:
+	vector<thread> workers;
+	queue<function<void()> > tasks;
+	mutex tasksLock;
+	condition_variable tasksReady;
+	bool stopping;
+	
+	void workerLoop();
+};
+
+// State of one client connection
+struct Connection {
+	int fd;
+	uint64_t id;
+	ExpSolver session;
+	
+	// Bytes of an incomplete request line
+	string inBuf;
+	
+	// Bytes at the start of inBuf already searched for '\n'
+	size_t scanned;
+	
+	// The incomplete line was too long; drop it up to the next '\n'
+	bool skippingLine;
+	
+	// Guarded by lock: requests not yet solved and
+	// replies not yet written to the socket
+	mutex lock;
+	deque<string> pending;
+	string outBuf;
+	
+	// Guarded by lock: bytes of requests in pending or being solved
+	size_t pendingBytes;
+	
+	// A worker is solving requests of this connection
+	// Only one at a time, so replies keep request order
+	bool busy;
+	
+	// No more requests will be read from this connection
+	bool readClosed;
+	
+	// Events currently registered with epoll
+	uint32_t events;
+	
+	Connection(int f, uint64_t i, const ExpSolver &initial)
+		: fd(f), id(i), session(initial), scanned(0), skippingLine(false),
+		pendingBytes(0), busy(false), readClosed(false), events(0) {}
+};
+
+class ExpServer {
+public:
+	
+	// Constructor; workerCount threads solve expressions
+	ExpServer(int workerCount);
+	~ExpServer();
+	
+	// Listen on a Unix domain socket at path
+	bool listenUnix(string path);
+	
+	// Listen on localhost TCP port
+	bool listenTcp(int port);
+	
+	// Start every new connection with the variables and ans
+	// of a snapshot file instead of an empty session
+	bool loadInitialSession(string fileName);
+	
+	// Run the event loop until stop() is called
+	void run(void);
+	
+	// Make run() return; safe to call from any thread
+	void stop(void);
+
+private:
+	
+	int listenFd;
+	int epollFd;
+	
+	// Written by workers (and stop) to wake up the event loop
+	int wakeFd;
+	atomic<bool> stopping;
+	
+	uint64_t nextConnectionId;
+	map<uint64_t, shared_ptr<Connection> > connections;
+	
+	// Session every connection starts from; only read once
+	// the server runs, so connections can fork it concurrently
+	ExpSolver initialSession;
+	
+	// Connections with new replies to write, filled by workers
+	mutex flushLock;
+	vector<uint64_t> toFlush;
+	
+	WorkerPool pool;
+	
+	// Event handlers run on the event loop thread
+	void acceptClients(void);
+	void readRequests(shared_ptr<Connection> conn);
+	void writeReplies(shared_ptr<Connection> conn);
+	void flushFromWorkers(void);
+	
+	// Register the events conn currently needs with epoll
+	void updateEvents(shared_ptr<Connection> conn);
+	
+	// Hand pending requests of conn to a worker if none is on it
+	void schedule(shared_ptr<Connection> conn);
+	
+	// Solve pending requests of conn; runs on a worker
+	void solvePending(shared_ptr<Connection> conn);
+	
+	void closeConnection(shared_ptr<Connection> conn);
+	
+	// Whether more can be read from conn while pendingBytes
+	// bytes of requests wait; called with conn.lock held
+	static bool readableBytes(const Connection &conn, size_t pendingBytes);
+	
+	// Solve one request line and build its reply line
+	static string solveRequest(ExpSolver &session, const string &request);
+};
+
+#endif
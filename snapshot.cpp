@@ -0,0 +1,253 @@
+/*
+
+snapshot.cpp
+
+Author: Jingyun Yang
+Date Created: 10/18/26
+
+Description: Implementation of SessionSnapshot.
+Snapshots are mapped with mmap and read in place,
+so loading one costs only the pages that are used.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+using namespace std;
+
+static const char SNAPSHOT_MAGIC[8] = {'E','X','P','S','N','A','P','\0'};
+
+// Entries are read straight out of the mapping, so their layout must not
+// depend on the compiler
+static_assert(sizeof(SnapshotValue) == 32, "SnapshotValue layout changed");
+static_assert(sizeof(SnapshotHeader) == 80, "SnapshotHeader layout changed");
+static_assert(sizeof(SnapshotEntry) == 40, "SnapshotEntry layout changed");
+
+// ******************** //
+// * Public Functions * //
+// ******************** //
+
+// Map the snapshot file read-only and validate its header
+SessionSnapshot *SessionSnapshot::open(string fileName) {
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if(fd < 0) {
+		errorStream() << "Cannot open snapshot \"" << fileName << "\"! ";
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+		errorStream() << "Snapshot \"" << fileName << "\" is truncated! ";
+		close(fd);
+		return NULL;
+	}
+	size_t len = st.st_size;
+	void *addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED) {
+		errorStream() << "Cannot map snapshot \"" << fileName << "\"! ";
+		return NULL;
+	}
+	
+	// Check magic, version and that every section lies inside the file
+	const SnapshotHeader *hdr = (const SnapshotHeader *)addr;
+	bool valid = memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+	if(valid && hdr->version != SNAPSHOT_VERSION) {
+		errorStream() << "Snapshot version " << hdr->version << " not supported! ";
+		munmap(addr, len);
+		return NULL;
+	}
+	uint64_t entriesEnd = sizeof(SnapshotHeader)
+		+ (uint64_t)hdr->entryCount * sizeof(SnapshotEntry);
+	valid = valid && entriesEnd <= hdr->elementTableOffset
+		&& hdr->elementTableOffset <= len
+		&& hdr->elementCount <= len / sizeof(SnapshotValue)
+		&& hdr->elementTableOffset + hdr->elementCount * sizeof(SnapshotValue)
+			<= hdr->stringTableOffset
+		&& hdr->stringTableOffset <= len
+		&& hdr->stringTableSize <= len - hdr->stringTableOffset;
+	if(!valid) {
+		errorStream() << "Snapshot \"" << fileName << "\" is corrupted! ";
+		munmap(addr, len);
+		return NULL;
+	}
+	SessionSnapshot *snapshot = new SessionSnapshot(addr, len);
+	valid = snapshot->elementsValid(hdr->ans);
+	for(int i = 0; valid && i < snapshot->size(); i++) {
+		const SnapshotEntry &entry = snapshot->entries[i];
+		valid = (uint64_t)entry.nameOffset + entry.nameLength <= hdr->stringTableSize
+			&& snapshot->elementsValid(entry.value);
+	}
+	if(!valid) {
+		errorStream() << "Snapshot \"" << fileName << "\" is corrupted! ";
+		delete snapshot;
+		return NULL;
+	}
+	return snapshot;
+}
+
+// Write variables and ans to fileName in snapshot format
+bool SessionSnapshot::write(string fileName, vector<string> names,
+		vector<Value> values, Value ans) {
+	// Sort entries by name so that lookups can binary search the mapping
+	vector<int> order;
+	for(int i = 0; i < (int)names.size(); i++) order.push_back(i);
+	sort(order.begin(), order.end(), [&names](int a, int b) {
+		return names[a] < names[b];
+	});
+	
+	SnapshotHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.entryCount = names.size();
+	
+	vector<SnapshotValue> elementTable;
+	hdr.ans = packValue(ans, elementTable);
+	
+	vector<SnapshotEntry> entries(names.size());
+	string stringTable;
+	for(int i = 0; i < (int)order.size(); i++) {
+		memset(&entries[i], 0, sizeof(SnapshotEntry));
+		entries[i].nameOffset = stringTable.length();
+		entries[i].nameLength = names[order[i]].length();
+		entries[i].value = packValue(values[order[i]], elementTable);
+		stringTable += names[order[i]];
+	}
+	hdr.elementTableOffset = sizeof(SnapshotHeader)
+		+ entries.size() * sizeof(SnapshotEntry);
+	hdr.elementCount = elementTable.size();
+	hdr.stringTableOffset = hdr.elementTableOffset
+		+ elementTable.size() * sizeof(SnapshotValue);
+	hdr.stringTableSize = stringTable.length();
+	
+	// Write to a temporary file first so that a crash never
+	// leaves a half-written snapshot behind
+	string tmpName = fileName + ".tmp";
+	ofstream out(tmpName.c_str(), ios::binary | ios::trunc);
+	if(!out) {
+		errorStream() << "Cannot write snapshot \"" << fileName << "\"! ";
+		return false;
+	}
+	out.write((const char *)&hdr, sizeof(hdr));
+	if(!entries.empty()) {
+		out.write((const char *)&entries[0], entries.size() * sizeof(SnapshotEntry));
+	}
+	if(!elementTable.empty()) {
+		out.write((const char *)&elementTable[0], elementTable.size() * sizeof(SnapshotValue));
+	}
+	out.write(stringTable.data(), stringTable.length());
+	out.close();
+	if(!out || rename(tmpName.c_str(), fileName.c_str()) != 0) {
+		errorStream() << "Cannot write snapshot \"" << fileName << "\"! ";
+		remove(tmpName.c_str());
+		return false;
+	}
+	return true;
+}
+
+SessionSnapshot::~SessionSnapshot() {
+	munmap(mapAddr, mapLength);
+}
+
+int SessionSnapshot::size() const {
+	return header->entryCount;
+}
+
+string SessionSnapshot::nameAt(int index) const {
+	return string(strings + entries[index].nameOffset, entries[index].nameLength);
+}
+
+Value SessionSnapshot::valueAt(int index) const {
+	return unpackValue(entries[index].value);
+}
+
+Value SessionSnapshot::getAns() const {
+	return unpackValue(header->ans);
+}
+
+// Binary search for a variable; returns false if not stored
+bool SessionSnapshot::find(const string &name, Value &val) const {
+	int lo = 0, hi = size();
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		const SnapshotEntry &entry = entries[mid];
+		int cmp = name.compare(0, string::npos,
+			strings + entry.nameOffset, entry.nameLength);
+		if(cmp == 0) {
+			val = unpackValue(entry.value);
+			return true;
+		}
+		if(cmp < 0) hi = mid;
+		else lo = mid + 1;
+	}
+	return false;
+}
+
+// ********************* //
+// * Private Functions * //
+// ********************* //
+
+SessionSnapshot::SessionSnapshot(void *addr, size_t len)
+	: mapAddr(addr), mapLength(len) {
+	header = (const SnapshotHeader *)addr;
+	entries = (const SnapshotEntry *)(header + 1);
+	elements = (const SnapshotValue *)((const char *)addr + header->elementTableOffset);
+	strings = (const char *)addr + header->stringTableOffset;
+}
+
+SnapshotValue SessionSnapshot::packValue(const Value &val, vector<SnapshotValue> &elementTable) {
+	SnapshotValue sv;
+	memset(&sv, 0, sizeof(sv));
+	if(val.isArray()) {
+		sv.isArray = 1;
+		sv.calculability = 1;
+		sv.elementIndex = elementTable.size();
+		sv.elementCount = val.getSize();
+		for(int i = 0; i < val.getSize(); i++) {
+			elementTable.push_back(packValue(val.elementAt(i), elementTable));
+		}
+		return sv;
+	}
+	sv.up = val.getFracValue().up;
+	sv.down = val.getFracValue().down;
+	sv.decValue = val.getDecValue();
+	sv.isDecimal = val.getDecimal();
+	sv.calculability = val.getCalculability();
+	return sv;
+}
+
+Value SessionSnapshot::unpackValue(const SnapshotValue &sv) const {
+	if(sv.isArray) {
+		vector<Value> arrayElements;
+		for(uint32_t i = 0; i < sv.elementCount; i++) {
+			arrayElements.push_back(unpackValue(elements[sv.elementIndex + i]));
+		}
+		return Value(arrayElements);
+	}
+	
+	// Assign the fraction directly: it was already reduced when saved
+	Fraction fv;
+	fv.up = sv.up;
+	fv.down = sv.down;
+	return Value(fv, sv.decValue, sv.isDecimal, sv.calculability);
+}
+
+// Whether the elements of sv lie inside the element table
+// Elements can't be arrays themselves
+bool SessionSnapshot::elementsValid(const SnapshotValue &sv) const {
+	if(!sv.isArray) return true;
+	if((uint64_t)sv.elementIndex + sv.elementCount > header->elementCount) return false;
+	for(uint32_t i = 0; i < sv.elementCount; i++) {
+		if(elements[sv.elementIndex + i].isArray) return false;
+	}
+	return true;
+}
@@ -0,0 +1,103 @@
+/*
+
+snapshot.h
+
+Author: Jingyun Yang
+Date Created: 10/18/26
+
+Description: Header file for versioned binary
+session snapshots. A snapshot stores the variables
+and "ans" of an ExpSolver session in a fixed-layout
+file that can be memory-mapped and read in place.
+
+File layout (native byte order):
+	SnapshotHeader
+	SnapshotEntry[entryCount]   (sorted by name)
+	SnapshotValue[elementCount] (elements of arrays)
+	char[stringTableSize]       (variable names)
+
+*/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "value.h"
+
+using namespace std;
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// Bump whenever the layout below changes
+const uint32_t SNAPSHOT_VERSION = 2;
+
+// Exact state of a Value, including its fraction/decimal form
+// The elements of an array are elementCount values of the
+// element table, starting at elementIndex
+struct SnapshotValue {
+	int32_t up, down;
+	double decValue;
+	uint8_t isDecimal, calculability, isArray;
+	uint8_t padding[5];
+	uint32_t elementIndex, elementCount;
+};
+
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entryCount;
+	uint64_t stringTableOffset;
+	uint64_t stringTableSize;
+	uint64_t elementTableOffset;
+	uint64_t elementCount;
+	SnapshotValue ans;
+};
+
+struct SnapshotEntry {
+	uint32_t nameOffset, nameLength;
+	SnapshotValue value;
+};
+
+class SessionSnapshot {
+public:
+	
+	// Map the snapshot file read-only and validate its header
+	// Returns NULL (and prints the reason) if the file can't be used
+	static SessionSnapshot *open(string fileName);
+	
+	// Write variables and ans to fileName in snapshot format
+	static bool write(string fileName, vector<string> names,
+		vector<Value> values, Value ans);
+	
+	~SessionSnapshot();
+	
+	// Getters that read directly from the mapped file
+	int size() const;
+	string nameAt(int index) const;
+	Value valueAt(int index) const;
+	Value getAns() const;
+	
+	// Binary search for a variable; returns false if not stored
+	bool find(const string &name, Value &val) const;
+
+private:
+	SessionSnapshot(void *addr, size_t len);
+	SessionSnapshot(const SessionSnapshot &);
+	SessionSnapshot &operator=(const SessionSnapshot &);
+	
+	void *mapAddr;
+	size_t mapLength;
+	const SnapshotHeader *header;
+	const SnapshotEntry *entries;
+	const SnapshotValue *elements;
+	const char *strings;
+	
+	// Elements of arrays are appended to elementTable
+	static SnapshotValue packValue(const Value &val, vector<SnapshotValue> &elementTable);
+	Value unpackValue(const SnapshotValue &sv) const;
+	
+	// Whether the elements of sv lie inside the element table
+	bool elementsValid(const SnapshotValue &sv) const;
+};
+
+#endif
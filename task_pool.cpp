@@ -0,0 +1,141 @@
+/*
+
+task_pool.cpp
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Implementation of TaskPool.
+
+*/
+
+#include "task_pool.h"
+
+using namespace std;
+
+// Index of the queue owned by this thread;
+// threads outside the pool use the shared queue
+static thread_local int ownQueue = -1;
+
+// ******************** //
+// * Public Functions * //
+// ******************** //
+
+// Constructor
+TaskPool::TaskPool(int threadCount) : queued(0), stopping(false) {
+	if(threadCount < 0) threadCount = 0;
+	for(int i = 0; i <= threadCount; i++) {
+		queues.push_back(unique_ptr<TaskQueue>(new TaskQueue()));
+	}
+	for(int i = 0; i < threadCount; i++) {
+		workers.push_back(thread(&TaskPool::workerLoop, this, i));
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for(int i = 0; i < (int)workers.size(); i++) workers[i].join();
+}
+
+// Pool shared by the whole process, sized to the machine
+TaskPool &TaskPool::shared() {
+	// The thread calling runAll works too, so leave it a core
+	static TaskPool pool((int)thread::hardware_concurrency() - 1);
+	return pool;
+}
+
+int TaskPool::concurrency() const {
+	return workers.size() + 1;
+}
+
+// Run all tasks and return once every one has finished
+void TaskPool::runAll(const vector<function<void()> > &tasks) {
+	if(tasks.empty()) return;
+	int self = ownQueue >= 0 ? ownQueue : (int)workers.size();
+	atomic<int> remaining((int)tasks.size());
+	
+	queued += tasks.size();
+	{
+		lock_guard<mutex> guard(queues[self]->lock);
+		for(int i = 0; i < (int)tasks.size(); i++) {
+			Task task = {&tasks[i], &remaining};
+			queues[self]->tasks.push_back(task);
+		}
+	}
+	{
+		lock_guard<mutex> guard(sleepLock);
+	}
+	wakeUp.notify_all();
+	
+	// Help out instead of blocking until our tasks are done; once there
+	// is nothing to take, sleep until more is queued or ours are done
+	while(remaining > 0) {
+		Task task;
+		if(takeTask(self, task)) {
+			runTask(task);
+			continue;
+		}
+		unique_lock<mutex> guard(sleepLock);
+		while(remaining > 0 && queued == 0) wakeUp.wait(guard);
+	}
+}
+
+// ********************* //
+// * Private Functions * //
+// ********************* //
+
+void TaskPool::workerLoop(int index) {
+	ownQueue = index;
+	while(1) {
+		Task task;
+		if(takeTask(index, task)) {
+			runTask(task);
+			continue;
+		}
+		unique_lock<mutex> guard(sleepLock);
+		while(!stopping && queued == 0) wakeUp.wait(guard);
+		if(stopping) return;
+	}
+}
+
+// Take a task from queue self, or steal one from another queue
+bool TaskPool::takeTask(int self, Task &task) {
+	// Own tasks come from the back (most recently forked, still in cache)
+	{
+		lock_guard<mutex> guard(queues[self]->lock);
+		if(!queues[self]->tasks.empty()) {
+			task = queues[self]->tasks.back();
+			queues[self]->tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	
+	// Stolen tasks come from the front (oldest, usually the largest)
+	int count = queues.size();
+	for(int i = 1; i < count; i++) {
+		TaskQueue &victim = *queues[(self + i) % count];
+		lock_guard<mutex> guard(victim.lock);
+		if(!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskPool::runTask(Task &task) {
+	(*task.run)();
+	
+	// The thread waiting for the last task may be asleep
+	if(--(*task.remaining) == 0) {
+		lock_guard<mutex> guard(sleepLock);
+		wakeUp.notify_all();
+	}
+}
@@ -0,0 +1,80 @@
+/*
+
+task_pool.h
+
+Author: Jingyun Yang
+Date Created: 10/19/26
+
+Description: Header file for TaskPool, a work
+stealing thread pool for fork-join parallelism.
+Every worker has its own deque of tasks; idle
+workers steal from the other deques, and a thread
+waiting for its tasks runs queued tasks meanwhile,
+so nested fork-join never deadlocks, and sleeps
+once there are none left to take.
+
+*/
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+using namespace std;
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+class TaskPool {
+public:
+	
+	// Constructor; threadCount workers are started
+	TaskPool(int threadCount);
+	~TaskPool();
+	
+	// Pool shared by the whole process, sized to the machine
+	static TaskPool &shared(void);
+	
+	// Number of threads that can work on tasks,
+	// counting the thread that calls runAll
+	int concurrency(void) const;
+	
+	// Run all tasks and return once every one has finished
+	void runAll(const vector<function<void()> > &tasks);
+
+private:
+	
+	struct Task {
+		const function<void()> *run;
+		atomic<int> *remaining;
+	};
+	
+	struct TaskQueue {
+		mutex lock;
+		deque<Task> tasks;
+	};
+	
+	// One queue per worker plus one shared by outside threads
+	vector<unique_ptr<TaskQueue> > queues;
+	vector<thread> workers;
+	
+	// Number of queued tasks, to let idle workers and threads
+	// waiting in runAll sleep; woken when tasks are queued
+	// and when the last task of a runAll finishes
+	atomic<int> queued;
+	mutex sleepLock;
+	condition_variable wakeUp;
+	atomic<bool> stopping;
+	
+	void workerLoop(int index);
+	
+	// Take a task from queue self, or steal one from another queue
+	bool takeTask(int self, Task &task);
+	void runTask(Task &task);
+};
+
+#endif
@@ -6,18 +6,51 @@ Author: Jingyun Yang
 Date Created: 10/2/16
 
 Description: Implementation of Value Class.
+Operators on arrays work element by element.
+Exact elements are calculated one at a time like
+single numbers; decimal elements are calculated
+in plain loops over the aligned buffers, which the
+compiler turns into SIMD instructions.
 
 */
 
+#include <limits.h>
+#include <stdlib.h>
 #include "value.h"
 
+static thread_local ostream *currentErrorStream = NULL;
+
+// Alignment of the elements of arrays, enough for any SIMD register
+static const size_t ARRAY_ALIGNMENT = 64;
+
+ostream &errorStream() {
+	return currentErrorStream ? *currentErrorStream : cerr;
+}
+
+void setErrorStream(ostream *stream) {
+	currentErrorStream = stream;
+}
+
+ValueArray::ValueArray(int n)
+	: size(n), decValues(NULL), fracValues(n), isDecimal(n, false), decimalCount(0) {
+	void *buffer = NULL;
+	if(posix_memalign(&buffer, ARRAY_ALIGNMENT, max(n, 1) * sizeof(double)) != 0) {
+		throw bad_alloc();
+	}
+	decValues = (double *)buffer;
+}
+
+ValueArray::~ValueArray() {
+	free(decValues);
+}
+
 Value::Value() 
 	: isDecimal(false), fracValue(Fraction()), decValue(0.0), calculability(false) {}
 
 Value::Value(Fraction fv) {
 	if(fv.down == 0) {
-		cerr << "Arithmatic error: Denominator is zero! ";
-		Value();
+		errorStream() << "Arithmatic error: Denominator is zero! ";
+		*this = Value();
 		return;
 	}
 	isDecimal = false;
@@ -27,6 +60,17 @@ Value::Value(Fraction fv) {
 }
 
 Value::Value(double dv) {
+	// Results like ln(-1) or exp(1000) can't be written as numbers
+	if(isnan(dv)) {
+		errorStream() << "Arithmatic error: Result is not a number! ";
+		*this = Value();
+		return;
+	}
+	if(isinf(dv)) {
+		errorStream() << "Arithmatic error: Number too large! ";
+		*this = Value();
+		return;
+	}
 	Value newValue = Value(to_string(dv));
 	*this = newValue;
 }
@@ -37,14 +81,15 @@ Value::Value(string str) {
 	if(found != string::npos) {
 		string left = str.substr(0,found);
 		string right = str.substr(found + 1);
+		if(left.length() == 0) left = "0";
 		if(left.length() >= 10) {
-			cerr << "Arithmatic error: Number too large! ";
+			errorStream() << "Arithmatic error: Number too large! ";
 			*this = Value();
 			return;
 		}
-		while(right.length() > 0 && right[right.length()-1] == '0') {
-			right = right.substr(0,right.length()-1);
-		}
+		// Trim trailing zeros at once, so long numbers stay cheap
+		size_t lastDigit = right.find_last_not_of('0');
+		right.erase(lastDigit == string::npos ? 0 : lastDigit + 1);
 		if(right.length() == 0) {
 			newValue = Value(Fraction(stoi(left), 1));
 			*this = newValue;
@@ -52,13 +97,17 @@ Value::Value(string str) {
 		}
 		else if(right.length() <= 5){
 			if(right.find('.') != string::npos) {
-				cerr << "Arithmatic Error: More than one '.' in a number! ";
-				Value();
+				errorStream() << "Arithmatic Error: More than one '.' in a number! ";
+				*this = Value();
 				return;
 			}
 			int leftNumber = stoi(left), rightNumber = stoi(right);
-			int multiplier = pow(10.0,(floor)(log10(rightNumber)) + 1.0);
-			newValue = Value(Fraction(leftNumber*multiplier+rightNumber,multiplier));
+			int multiplier = 1;
+			for(int k = 0; k < (int)right.length(); k++) multiplier *= 10;
+			// Keep the sign of numbers like "-0.5" whose integer part is zero
+			int upNumber = abs(leftNumber)*multiplier+rightNumber;
+			if(left[0] == '-') upNumber = -upNumber;
+			newValue = Value(Fraction(upNumber,multiplier));
 			*this = newValue;
 			return;
 		}
@@ -70,11 +119,38 @@ Value::Value(string str) {
 			return;
 		}
 	}
+	// Integers that don't fit in a fraction are rejected (stoi would throw)
+	if(str.length() > 11 || llabs(stoll(str)) > INT_MAX) {
+		errorStream() << "Arithmatic error: Number too large! ";
+		*this = Value();
+		return;
+	}
 	newValue = Value(Fraction(stoi(str),1));
 	*this = newValue;
 	return;
 }
 
+Value::Value(const vector<Value> &elements) : Value() {
+	for(int i = 0; i < (int)elements.size(); i++) {
+		if(!elements[i].getCalculability()) return;
+		if(elements[i].isArray()) {
+			errorStream() << "Arithmatic error: Arrays can't be nested! ";
+			return;
+		}
+	}
+	
+	shared_ptr<ValueArray> newArray = make_shared<ValueArray>(elements.size());
+	for(int i = 0; i < (int)elements.size(); i++) {
+		newArray->decValues[i] = elements[i].getDecValue();
+		newArray->fracValues[i] = elements[i].getFracValue();
+		newArray->isDecimal[i] = elements[i].getDecimal();
+	}
+	*this = arrayValue(newArray);
+}
+
+Value::Value(Fraction fv, double dv, bool dec, bool calc)
+	: isDecimal(dec), fracValue(fv), decValue(dv), calculability(calc) {}
+
 bool Value::getDecimal() const {
 	return isDecimal;
 }
@@ -91,8 +167,82 @@ bool Value::getCalculability() const {
 	return calculability;
 }
 
+bool Value::isArray() const {
+	return array != NULL;
+}
+
+int Value::getSize() const {
+	return array ? array->size : 1;
+}
+
+Value Value::elementAt(int index) const {
+	if(!array) return *this;
+	if(array->isDecimal[index]) return Value(Fraction(), array->decValues[index], true, true);
+	return Value(array->fracValues[index]);
+}
+
+// Largest absolute value of the number or of any element
+double Value::getMagnitude() const {
+	if(array) {
+		double magnitude = 0;
+		for(int i = 0; i < array->size; i++) {
+			magnitude = max(magnitude, fabs(array->decValues[i]));
+		}
+		for(int i = 0; i < array->size; i++) {
+			if(array->isDecimal[i]) continue;
+			magnitude = max(magnitude, fabs((double)array->fracValues[i].up));
+			magnitude = max(magnitude, fabs((double)array->fracValues[i].down));
+		}
+		return magnitude;
+	}
+	double magnitude = fabs(decValue);
+	if(!isDecimal) {
+		magnitude = max(magnitude, fabs((double)fracValue.up));
+		magnitude = max(magnitude, fabs((double)fracValue.down));
+	}
+	return magnitude;
+}
+
+// Whether the number or any element is negative
+bool Value::hasNegative() const {
+	if(!array) return decValue < 0;
+	bool negative = false;
+	for(int i = 0; i < array->size; i++) negative |= array->decValues[i] < 0;
+	return negative;
+}
+
+// Apply func to the number, or to every element of an array
+Value Value::applyFunction(double (*func)(double)) const {
+	if(!calculability) return Value();
+	
+	// Every way of applying a function gives this error for square roots;
+	// other functions report values outside their domain as not a number
+	if(func == (double (*)(double))sqrt && hasNegative()) {
+		errorStream() << "Arithmatic error: Cannot square root a negative number! ";
+		return Value();
+	}
+	if(!array) return Value((*func)(decValue));
+	
+	shared_ptr<ValueArray> results = make_shared<ValueArray>(array->size);
+	for(int i = 0; i < array->size; i++) {
+		results->decValues[i] = (*func)(array->decValues[i]);
+	}
+	for(int i = 0; i < array->size; i++) {
+		if(!roundElement(*results, i)) return Value();
+	}
+	return arrayValue(results);
+}
+
 string Value::printValue() const {
 	if(!calculability) return "";
+	if(array) {
+		string str = "[";
+		for(int i = 0; i < array->size; i++) {
+			if(i > 0) str += ", ";
+			str += elementAt(i).printValue();
+		}
+		return str + "]";
+	}
 	if(isDecimal) {
 		return to_string(decValue);
 	}
@@ -109,13 +259,17 @@ Value& Value::operator+=(const Value z) {
 		*this = Value();
 		return *this;
 	}
+	if(array || z.array) {
+		*this = elementWise(*this, z, '+');
+		return *this;
+	}
 	if(isDecimal || z.getDecimal()) {
 		*this = Value(decValue+z.getDecValue());
 	}
 	else {
-		*this = Value(Fraction(fracValue.up*z.getFracValue().down
-			+fracValue.down*z.getFracValue().up
-			,z.getFracValue().down*fracValue.down));
+		*this = exactFraction((long long)fracValue.up*z.getFracValue().down
+			+(long long)fracValue.down*z.getFracValue().up
+			,(long long)z.getFracValue().down*fracValue.down);
 	}
 	return *this;
 }
@@ -125,13 +279,17 @@ Value& Value::operator-=(const Value z) {
 		*this = Value();
 		return *this;
 	}
+	if(array || z.array) {
+		*this = elementWise(*this, z, '-');
+		return *this;
+	}
 	if(isDecimal || z.getDecimal()) {
 		*this = Value(decValue-z.getDecValue());
 	}
 	else {
-		*this = Value(Fraction(fracValue.up*z.getFracValue().down
-			-fracValue.down*z.getFracValue().up
-			,z.getFracValue().down*fracValue.down));
+		*this = exactFraction((long long)fracValue.up*z.getFracValue().down
+			-(long long)fracValue.down*z.getFracValue().up
+			,(long long)z.getFracValue().down*fracValue.down);
 	}
 	return *this;
 }
@@ -141,12 +299,16 @@ Value& Value::operator*=(const Value z) {
 		*this = Value();
 		return *this;
 	}
+	if(array || z.array) {
+		*this = elementWise(*this, z, '*');
+		return *this;
+	}
 	if(isDecimal || z.getDecimal()) {
 		*this = Value(decValue*z.getDecValue());
 	}
 	else {
-		*this = Value(Fraction(z.getFracValue().up*fracValue.up
-			,z.getFracValue().down*fracValue.down));
+		*this = exactFraction((long long)z.getFracValue().up*fracValue.up
+			,(long long)z.getFracValue().down*fracValue.down);
 	}
 	return *this;
 }
@@ -156,12 +318,16 @@ Value& Value::operator/=(const Value z) {
 		*this = Value();
 		return *this;
 	}
+	if(array || z.array) {
+		*this = elementWise(*this, z, '/');
+		return *this;
+	}
 	if(isDecimal || z.getDecimal()) {
 		*this = Value(decValue/z.getDecValue());
 	}
 	else {
-		*this = Value(Fraction(z.getFracValue().down*fracValue.up
-			,z.getFracValue().up*fracValue.down));
+		*this = exactFraction((long long)z.getFracValue().down*fracValue.up
+			,(long long)z.getFracValue().up*fracValue.down);
 	}
 	return *this;
 }
@@ -171,24 +337,236 @@ Value& Value::powv(const Value z) {
 		*this = Value();
 		return *this;
 	}
+	if(array || z.array) {
+		*this = elementWise(*this, z, '^');
+		return *this;
+	}
 	if(decValue < 0 && z.getDecValue() != (double)(int(z.getDecValue()))) {
-		cerr << "Arithmatic error: Can't power a negative number by a non-integer! ";
+		errorStream() << "Arithmatic error: Can't power a negative number by a non-integer! ";
 		*this = Value();
 		return *this;
 	}
-	if(!isDecimal && z.getDecValue() == (double)(int(z.getDecValue()))) {
-		fracValue.up = pow(fracValue.up,fabs(z.getDecValue()));
-		fracValue.down = pow(fracValue.down,fabs(z.getDecValue()));
-        if(z.getDecValue() < 0) {
-            swap(fracValue.up,fracValue.down);
-            if(fracValue.down < 0) {
-                fracValue.up *= -1;
-                fracValue.down *= -1;
-            }
-        }
+	
+	// Keep fractions exact: the numerator of the exponent is an integer
+	// power and its denominator a root, taken only if the roots are exact
+	if(!isDecimal && !z.getDecimal()) {
+		long long up = fracValue.up, down = fracValue.down;
+		long long expUp = z.getFracValue().up, expDown = z.getFracValue().down;
+		if(down < 0) { up = -up; down = -down; }
+		if(expDown < 0) { expUp = -expUp; expDown = -expDown; }
+		
+		long long rootUp, rootDown;
+		bool exact = rootOf(llabs(up), expDown, rootUp) && rootOf(down, expDown, rootDown);
+		if(exact) {
+			if(up < 0) rootUp = -rootUp;
+			long long powUp, powDown;
+			if(checkedPow(rootUp, llabs(expUp), powUp) && checkedPow(rootDown, llabs(expUp), powDown)) {
+				// Keep the sign in the numerator when a negative base is inverted
+				if(expUp < 0) swap(powUp, powDown);
+				if(powDown < 0) { powUp = -powUp; powDown = -powDown; }
+				*this = Value(Fraction((int)powUp, (int)powDown));
+				return *this;
+			}
+			
+			// Too large for a fraction: keep the decimal value as it is,
+			// since Value(double) only takes numbers that fit in one
+			double result = pow(decValue, z.getDecValue());
+			if(isinf(result)) {
+				errorStream() << "Arithmatic error: Number too large! ";
+				*this = Value();
+				return *this;
+			}
+			*this = Value(Fraction(), result, true, true);
+			return *this;
+		}
+	}
+	*this = Value(pow(decValue,z.getDecValue()));
+	return *this;
+}
+
+// ********************* //
+// * Private Functions * //
+// ********************* //
+
+// Calculate op for every pair of elements; a number
+// is used with every element of the other array
+Value Value::elementWise(const Value &a, const Value &b, char op) {
+	if(a.array && b.array && a.array->size != b.array->size) {
+		errorStream() << "Arithmatic error: Array sizes don't match! ";
+		return Value();
+	}
+	int size = a.array ? a.array->size : b.array->size;
+	
+	// Arrays of fractions are calculated one element at a time,
+	// like single numbers
+	if(!a.isDecimal && !b.isDecimal) {
+		vector<Value> results(size);
+		for(int i = 0; i < size; i++) {
+			results[i] = exactElement(a.elementAt(i), b.elementAt(i), op);
+			if(!results[i].getCalculability()) return Value();
+		}
+		return Value(results);
+	}
+	
+	// Otherwise the decimal values of all elements are calculated at once
+	shared_ptr<const ValueArray> left = broadcast(a, size), right = broadcast(b, size);
+	shared_ptr<ValueArray> results = make_shared<ValueArray>(size);
+	const double *x = left->decValues, *y = right->decValues;
+	double *z = results->decValues;
+	if(op == '+') {
+		for(int i = 0; i < size; i++) z[i] = x[i] + y[i];
+	}
+	else if(op == '-') {
+		for(int i = 0; i < size; i++) z[i] = x[i] - y[i];
+	}
+	else if(op == '*') {
+		for(int i = 0; i < size; i++) z[i] = x[i] * y[i];
+	}
+	else if(op == '/') {
+		for(int i = 0; i < size; i++) z[i] = x[i] / y[i];
 	}
 	else {
-		*this = Value(pow(decValue,z.getDecValue()));
+		for(int i = 0; i < size; i++) z[i] = pow(x[i], y[i]);
 	}
-	return *this;
-}
\ No newline at end of file
+	
+	// Elements that are both fractions are calculated again exactly,
+	// the others are rounded like single numbers
+	for(int i = 0; i < size; i++) {
+		if(!left->isDecimal[i] && !right->isDecimal[i]) {
+			Value exact = exactElement(a.elementAt(i), b.elementAt(i), op);
+			if(!exact.getCalculability()) return Value();
+			results->decValues[i] = exact.getDecValue();
+			results->fracValues[i] = exact.getFracValue();
+			results->isDecimal[i] = exact.getDecimal();
+		}
+		else if(op == '^' && x[i] < 0 && y[i] != (double)(int)y[i]) {
+			errorStream() << "Arithmatic error: Can't power a negative number by a non-integer! ";
+			return Value();
+		}
+		else if(!roundElement(*results, i)) return Value();
+	}
+	return arrayValue(results);
+}
+
+// Calculate op for two numbers
+Value Value::exactElement(Value x, const Value &y, char op) {
+	if(op == '+') return x += y;
+	if(op == '-') return x -= y;
+	if(op == '*') return x *= y;
+	if(op == '/') return x /= y;
+	return x.powv(y);
+}
+
+// Array of size elements that are all val
+shared_ptr<const ValueArray> Value::broadcast(const Value &val, int size) {
+	if(val.array) return val.array;
+	shared_ptr<ValueArray> elements = make_shared<ValueArray>(size);
+	for(int i = 0; i < size; i++) {
+		elements->decValues[i] = val.decValue;
+		elements->fracValues[i] = val.fracValue;
+		elements->isDecimal[i] = val.isDecimal;
+	}
+	return elements;
+}
+
+// Value of an array whose elements are set
+Value Value::arrayValue(const shared_ptr<ValueArray> &elements) {
+	elements->decimalCount = 0;
+	for(int i = 0; i < elements->size; i++) {
+		if(elements->isDecimal[i]) elements->decimalCount++;
+	}
+	Value result;
+	result.array = elements;
+	result.isDecimal = elements->decimalCount > 0;
+	result.calculability = true;
+	return result;
+}
+
+// Round a decimal element like Value(double) does
+bool Value::roundElement(ValueArray &elements, int index) {
+	double element = elements.decValues[index];
+	if(isnan(element)) {
+		errorStream() << "Arithmatic error: Result is not a number! ";
+		return false;
+	}
+	
+	// Millionths, rounded like to_string does: the product is
+	// scaled + error exactly, so ties are found and go to even
+	double scaled = element * 1e6, error = fma(element, 1e6, -scaled);
+	double rounded = nearbyint(scaled), rest = (scaled - rounded) + error;
+	if(rest > 0.5 || (rest == 0.5 && fmod(rounded, 2) != 0)) rounded += 1;
+	else if(rest < -0.5 || (rest == -0.5 && fmod(rounded, 2) != 0)) rounded -= 1;
+	
+	// Value(string) takes at most 9 characters before the point, sign included
+	if(isinf(element) || rounded >= 1e15 || rounded <= -1e14) {
+		errorStream() << "Arithmatic error: Number too large! ";
+		return false;
+	}
+	long long up = (long long)rounded, down = 1000000;
+	elements.decValues[index] = up / 1e6;
+	elements.isDecimal[index] = true;
+	if(up % 10 == 0) {
+		long long a = llabs(up), b = down;
+		while(b != 0) { long long t = a % b; a = b; b = t; }
+		up /= a;
+		down /= a;
+		if(llabs(up) <= INT_MAX) {
+			elements.fracValues[index] = Fraction(up, down);
+			elements.isDecimal[index] = false;
+		}
+	}
+	return true;
+}
+
+// Fraction up/down of the exact result of an operator; if it doesn't
+// fit in a fraction it is kept as a decimal, like large powers
+Value Value::exactFraction(long long up, long long down) {
+	if(down == 0) return Value(Fraction(1, 0));
+	long long a = llabs(up), b = llabs(down);
+	while(b != 0) { long long t = a % b; a = b; b = t; }
+	up /= a;
+	down /= a;
+	if(llabs(up) <= INT_MAX && llabs(down) <= INT_MAX) {
+		return Value(Fraction((int)up, (int)down));
+	}
+	return Value(Fraction(), (double)up / down, true, true);
+}
+
+// base^exponent by squaring; returns false if the result
+// doesn't fit in an int (exponent must not be negative)
+bool Value::checkedPow(long long base, long long exponent, long long &result) {
+	result = 1;
+	while(exponent > 0) {
+		if(exponent & 1) {
+			result *= base;
+			if(llabs(result) > INT_MAX) return false;
+		}
+		exponent >>= 1;
+		
+		// |base| <= INT_MAX here, so squaring it can't overflow
+		if(exponent > 0) {
+			base *= base;
+			if(llabs(base) > INT_MAX) return false;
+		}
+	}
+	return true;
+}
+
+// Exact n-th root of x >= 0; returns false if x is not a perfect power
+bool Value::rootOf(long long x, long long n, long long &root) {
+	if(n == 1 || x <= 1) {
+		root = x;
+		return true;
+	}
+	
+	// pow gives the root to within one; check the neighbours exactly
+	long long guess = llround(pow((double)x, 1.0 / n));
+	for(long long r = max(guess - 1, 0LL); r <= guess + 1; r++) {
+		long long power;
+		if(checkedPow(r, n, power) && power == x) {
+			root = r;
+			return true;
+		}
+	}
+	return false;
+}
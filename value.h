@@ -7,30 +7,57 @@ Date Created: 10/2/16
 
 Description: Header file for arithmatic type
 Value that stores numbers represented in either
-fraction or decimal format.
+fraction or decimal format, or arrays of them.
 
 */
 
 #include <iostream>
 #include <math.h>
 #include <string>
+#include <vector>
+#include <memory>
 
 using namespace std;
 
 #ifndef VALUE_H
 #define VALUE_H
 
+// Stream that error messages are written to (cerr unless redirected)
+// The redirection is per thread, so concurrent sessions don't mix messages
+ostream &errorStream();
+void setErrorStream(ostream *stream);
+
 struct Fraction {
 	int up, down;
 	Fraction() : up(0), down(1) {}
 	Fraction(int u, int d) : up(u), down(d) {
-		// Ensure that GCD(up,down)=1
-		for(int k=2;k<=min(abs(up),abs(down));k++){
-		    while(abs(up)%k==0 && abs(down)%k==0){up/=k;down/=k;}
-		}
+		// Ensure that GCD(up,down)=1 (Euclid, so large values stay cheap)
+		int a = abs(up), b = abs(down);
+		while(b != 0) { int t = a % b; a = b; b = t; }
+		if(a > 1) { up /= a; down /= a; }
 	}
 };
 
+// Elements of an array Value. The decimal values of all elements are
+// kept in one contiguous buffer, aligned so that element-wise loops can
+// use SIMD; elements that are exact keep their fraction as well
+// Arrays are never modified once they are built
+struct ValueArray {
+	int size;
+	double *decValues;
+	vector<Fraction> fracValues;
+	vector<bool> isDecimal;
+	
+	// Number of decimal elements
+	int decimalCount;
+	
+	ValueArray(int n);
+	~ValueArray();
+private:
+	ValueArray(const ValueArray &);
+	ValueArray &operator=(const ValueArray &);
+};
+
 class Value {
 public:
 	// Constructors
@@ -39,12 +66,34 @@ public:
 	Value(double dv);
 	Value(string str);
 	
+	// Array of elements, which must be numbers
+	Value(const vector<Value> &elements);
+	
+	// Restore a value from its raw state (used by session snapshots)
+	Value(Fraction fv, double dv, bool dec, bool calc);
+	
 	// Getters
 	bool getDecimal() const;
 	Fraction getFracValue() const;
 	double getDecValue() const;
 	bool getCalculability() const;
 	
+	// Arrays; getDecValue and getFracValue are meaningless for them
+	bool isArray() const;
+	int getSize() const;
+	Value elementAt(int index) const;
+	
+	// Largest absolute value of the number or of any element,
+	// counting both parts of fractions
+	double getMagnitude() const;
+	
+	// Whether the number or any element is negative
+	bool hasNegative() const;
+	
+	// Apply func to the number, or to every element of an array
+	// A square root of a negative number is an error
+	Value applyFunction(double (*func)(double)) const;
+	
 	// Print the value of the object
 	string printValue() const;
 	
@@ -68,6 +117,35 @@ private:
 	Fraction fracValue;
 	double decValue;
 	bool calculability;
+	
+	// Elements if the value is an array, NULL otherwise
+	shared_ptr<const ValueArray> array;
+	
+	// Calculate op ('+' '-' '*' '/' '^') for every pair of elements;
+	// a number is used with every element of the other array
+	static Value elementWise(const Value &a, const Value &b, char op);
+	
+	// Calculate op for two numbers
+	static Value exactElement(Value x, const Value &y, char op);
+	
+	// Array of size elements that are all val
+	static shared_ptr<const ValueArray> broadcast(const Value &val, int size);
+	
+	// Value of an array whose elements are set
+	static Value arrayValue(const shared_ptr<ValueArray> &elements);
+	
+	// Round a decimal element like Value(double) does: to 6 decimal
+	// places, and exact if there are 5 or fewer; returns false (and
+	// prints the reason) if it can't be a Value
+	static bool roundElement(ValueArray &elements, int index);
+	
+	// Exact result up/down of an operator on fractions; a decimal
+	// if it doesn't fit in a fraction
+	static Value exactFraction(long long up, long long down);
+	
+	// Integer helpers for exact powers of fractions
+	static bool checkedPow(long long base, long long exponent, long long &result);
+	static bool rootOf(long long x, long long n, long long &root);
 };
 
 #endif
\ No newline at end of file